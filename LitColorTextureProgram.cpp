@@ -15,6 +15,11 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
 	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
 
+	lit_color_texture_program_pipeline.INSTANCED_bool = ret->INSTANCED_bool;
+	lit_color_texture_program_pipeline.INSTANCE_OBJECT_TO_CLIP_mat4 = ret->INSTANCE_OBJECT_TO_CLIP_mat4;
+	lit_color_texture_program_pipeline.INSTANCE_OBJECT_TO_LIGHT_mat4x3 = ret->INSTANCE_OBJECT_TO_LIGHT_mat4x3;
+	lit_color_texture_program_pipeline.INSTANCE_NORMAL_TO_LIGHT_mat3 = ret->INSTANCE_NORMAL_TO_LIGHT_mat3;
+
 	/* This will be used later if/when we build a light loop into the Scene:
 	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
 	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
@@ -51,6 +56,10 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"uniform mat4 OBJECT_TO_CLIP;\n"
 		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
 		"uniform mat3 NORMAL_TO_LIGHT;\n"
+		"uniform bool INSTANCED;\n" //if set, read matrices from per-instance attributes instead:
+		"in mat4 INSTANCE_OBJECT_TO_CLIP;\n"
+		"in mat4x3 INSTANCE_OBJECT_TO_LIGHT;\n"
+		"in mat3 INSTANCE_NORMAL_TO_LIGHT;\n"
 		"in vec4 Position;\n"
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
@@ -60,9 +69,15 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
 		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	if (INSTANCED) {\n"
+		"		gl_Position = INSTANCE_OBJECT_TO_CLIP * Position;\n"
+		"		position = INSTANCE_OBJECT_TO_LIGHT * Position;\n"
+		"		normal = INSTANCE_NORMAL_TO_LIGHT * Normal;\n"
+		"	} else {\n"
+		"		gl_Position = OBJECT_TO_CLIP * Position;\n"
+		"		position = OBJECT_TO_LIGHT * Position;\n"
+		"		normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	}\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
@@ -114,11 +129,15 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	Normal_vec3 = glGetAttribLocation(program, "Normal");
 	Color_vec4 = glGetAttribLocation(program, "Color");
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
+	INSTANCE_OBJECT_TO_CLIP_mat4 = glGetAttribLocation(program, "INSTANCE_OBJECT_TO_CLIP");
+	INSTANCE_OBJECT_TO_LIGHT_mat4x3 = glGetAttribLocation(program, "INSTANCE_OBJECT_TO_LIGHT");
+	INSTANCE_NORMAL_TO_LIGHT_mat3 = glGetAttribLocation(program, "INSTANCE_NORMAL_TO_LIGHT");
 
 	//look up the locations of uniforms:
 	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
 	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
 	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	INSTANCED_bool = glGetUniformLocation(program, "INSTANCED");
 
 	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
 	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
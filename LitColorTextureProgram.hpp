@@ -16,11 +16,16 @@ struct LitColorTextureProgram {
 	GLuint Normal_vec3 = -1U;
 	GLuint Color_vec4 = -1U;
 	GLuint TexCoord_vec2 = -1U;
+	//(per-instance, used when INSTANCED is set; see Scene::Drawable::Pipeline)
+	GLuint INSTANCE_OBJECT_TO_CLIP_mat4 = -1U;
+	GLuint INSTANCE_OBJECT_TO_LIGHT_mat4x3 = -1U;
+	GLuint INSTANCE_NORMAL_TO_LIGHT_mat3 = -1U;
 
 	//Uniform (per-invocation variable) locations:
 	GLuint OBJECT_TO_CLIP_mat4 = -1U;
 	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
 	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+	GLuint INSTANCED_bool = -1U;
 
 	//lighting:
 	GLuint LIGHT_TYPE_int = -1U;
@@ -1,20 +1,124 @@
 #include "Load.hpp"
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <iomanip>
+#include <iostream>
 #include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <cassert>
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
+	struct LoadFunction {
+		std::function< void() > cpu_fn; //run on a worker thread (may be empty)
+		std::function< void() > fn; //run on the main thread (may be empty)
+		std::string name;
+
+		//filled in while loading:
+		bool cpu_done = false; //protected by the pool's mutex
+		std::exception_ptr cpu_error;
+		double cpu_ms = 0.0;
+		double main_ms = 0.0;
+	};
+
+	std::array< std::list< LoadFunction >, MaxLoadTag > &get_load_lists() {
+		static std::array< std::list< LoadFunction >, MaxLoadTag > load_lists;
 		return load_lists;
 	}
+
+	typedef std::chrono::high_resolution_clock Clock;
+	double ms_since(Clock::time_point before) {
+		return std::chrono::duration< double, std::milli >(Clock::now() - before).count();
+	}
+
+	//Worker threads that run the 'cpu_fn' stages of one tag's functions at a time:
+	struct WorkerPool {
+		WorkerPool(uint32_t count) {
+			for (uint32_t i = 0; i < count; ++i) {
+				workers.emplace_back(&WorkerPool::work, this);
+			}
+		}
+		~WorkerPool() {
+			{
+				std::lock_guard< std::mutex > guard(mutex);
+				quit = true;
+				pending.clear(); //(if loading failed, don't bother with the rest)
+			}
+			wake_workers.notify_all();
+			for (auto &worker : workers) {
+				worker.join();
+			}
+		}
+
+		//queue the cpu stages of every function in 'list':
+		void start(std::list< LoadFunction > &list) {
+			{
+				std::lock_guard< std::mutex > guard(mutex);
+				for (auto &lf : list) {
+					if (lf.cpu_fn) pending.emplace_back(&lf);
+				}
+			}
+			wake_workers.notify_all();
+		}
+
+		//block until the cpu stage of 'lf' is done:
+		void wait(LoadFunction &lf) {
+			std::unique_lock< std::mutex > lock(mutex);
+			wake_main.wait(lock, [&](){ return lf.cpu_done; });
+		}
+
+		void work() {
+			std::unique_lock< std::mutex > lock(mutex);
+			while (true) {
+				wake_workers.wait(lock, [this](){ return quit || !pending.empty(); });
+				if (pending.empty()) break; //(quit)
+				LoadFunction &lf = *pending.front();
+				pending.erase(pending.begin());
+				lock.unlock();
+
+				auto before = Clock::now();
+				try {
+					lf.cpu_fn();
+				} catch (...) {
+					lf.cpu_error = std::current_exception();
+				}
+				lf.cpu_ms = ms_since(before);
+
+				lock.lock();
+				lf.cpu_done = true;
+				wake_main.notify_all();
+			}
+		}
+
+		std::mutex mutex;
+		std::condition_variable wake_workers; //signalled when work is added
+		std::condition_variable wake_main; //signalled when work is finished
+		std::vector< LoadFunction * > pending; //in declaration order, so that earlier loads finish first
+		bool quit = false;
+		std::vector< std::thread > workers;
+	};
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
+void add_load_function(LoadTag tag, std::function< void() > const &fn, std::string const &name) {
 	auto &load_lists = get_load_lists();
 	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+	load_lists[tag].emplace_back();
+	load_lists[tag].back().fn = fn;
+	load_lists[tag].back().name = name;
+}
+
+void add_load_function(LoadTag tag, std::function< void() > const &cpu_fn, std::function< void() > const &gl_fn, std::string const &name) {
+	auto &load_lists = get_load_lists();
+	assert(tag < load_lists.size());
+	load_lists[tag].emplace_back();
+	load_lists[tag].back().cpu_fn = cpu_fn;
+	load_lists[tag].back().fn = gl_fn;
+	load_lists[tag].back().name = name;
 }
 
 void call_load_functions() {
@@ -23,10 +127,56 @@ void call_load_functions() {
 	has_been_called = true;
 
 	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+
+	//(the main thread is busy with the second stages, so leave it a core)
+	WorkerPool pool(std::max(2U, std::thread::hardware_concurrency()) - 1U);
+
+	auto before_all = Clock::now();
+	double serial_ms = 0.0; //time all the loads would have taken one after another
+	for (uint32_t tag = 0; tag < load_lists.size(); ++tag) {
+		auto &fn_list = load_lists[tag];
+		pool.start(fn_list);
+
+		//main-thread stages happen in declaration order:
+		uint32_t index = 0;
+		for (auto &lf : fn_list) {
+			if (lf.cpu_fn) {
+				pool.wait(lf);
+				if (lf.cpu_error) std::rethrow_exception(lf.cpu_error);
+			}
+			if (lf.fn) {
+				auto before = Clock::now();
+				lf.fn();
+				lf.main_ms = ms_since(before);
+			}
+			if (lf.name.empty()) {
+				lf.name = "(tag " + std::to_string(tag) + " #" + std::to_string(index) + ")";
+			}
+			++index;
 		}
+		for (auto const &lf : fn_list) {
+			serial_ms += lf.cpu_ms + lf.main_ms;
+		}
+	}
+	double total_ms = ms_since(before_all);
+
+	//report:
+	std::ios old_format(nullptr);
+	old_format.copyfmt(std::cout);
+	std::cout << "Load times (ms):\n";
+	std::cout << std::fixed << std::setprecision(1);
+	for (auto const &fn_list : load_lists) {
+		for (auto const &lf : fn_list) {
+			std::cout << "  " << std::left << std::setw(28) << lf.name << std::right;
+			if (lf.cpu_fn) std::cout << " worker " << std::setw(7) << lf.cpu_ms;
+			else std::cout << "               ";
+			std::cout << "   main " << std::setw(7) << lf.main_ms << "\n";
+		}
+	}
+	std::cout << "  total " << total_ms << " ms (" << serial_ms << " ms if loaded one at a time)." << std::endl;
+	std::cout.copyfmt(old_format);
+
+	for (auto &fn_list : load_lists) {
+		fn_list.clear();
 	}
 }
@@ -20,10 +20,24 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Loads that spend most of their time reading or decoding files can be split into two stages:
+ *
+ * Load< MeshBuffer > meshes(LoadTagDefault, []() -> MeshBuffer * {
+ *     return new MeshBuffer(data_path("main.pnct"), MeshBuffer::DeferUpload); //worker thread: read file
+ * }, [](MeshBuffer *buffer) {
+ *     buffer->upload(); //main thread: OpenGL calls
+ * }, "main.pnct");
+ *
+ * The first stages of all loads with the same tag run in parallel on a pool of worker threads,
+ * while the second stages (and all single-stage loads) run on the main thread, in the order the loads were declared.
+ * Every load with a given tag finishes before any load with a later tag starts.
+ *
  */
 
 #include <functional>
+#include <memory>
 #include <stdexcept>
+#include <string>
 
 enum LoadTag : uint32_t {
 	LoadTagEarly,
@@ -34,11 +48,18 @@ enum LoadTag : uint32_t {
 
 //Add a function to an internal list of loading functions:
 // (only call *before* "call_load_functions()")
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+// ('name' is used in the timing report; empty names are reported by tag and position)
+void add_load_function(LoadTag tag, std::function< void() > const &fn, std::string const &name = "");
+
+//Add a two-stage loading function:
+// 'cpu_fn' runs on a worker thread, so must not make OpenGL calls or depend on other loads with the same tag;
+// 'gl_fn' (may be empty) runs afterward on the main thread.
+void add_load_function(LoadTag tag, std::function< void() > const &cpu_fn, std::function< void() > const &gl_fn, std::string const &name);
 
 //Call all loading functions:
 // (loading functions may throw exceptions if they fail.)
 // (only call *once*)
+// prints how long each load took once done.
 void call_load_functions();
 
 
@@ -49,13 +70,27 @@ T const *new_T() { return new T; }
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
+	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >, std::string const &name = "") : value(nullptr) {
 		add_load_function(tag, [this,load_fn](){
 			this->value = load_fn();
 			if (!(this->value)) {
 				throw std::runtime_error("Loading failed.");
 			}
-		});
+		}, name);
+	}
+
+	//Two-stage version: 'cpu_fn' creates the T on a worker thread, 'gl_fn' (if not empty) finishes it on the main thread:
+	Load(LoadTag tag, const std::function< T *() > &cpu_fn, const std::function< void(T *) > &gl_fn, std::string const &name) : value(nullptr) {
+		auto loaded = std::make_shared< T * >(nullptr); //hand-off between stages
+		add_load_function(tag, [loaded,cpu_fn](){
+			*loaded = cpu_fn();
+			if (!*loaded) {
+				throw std::runtime_error("Loading failed.");
+			}
+		}, [this,loaded,gl_fn](){
+			if (gl_fn) gl_fn(*loaded);
+			this->value = *loaded;
+		}, name);
 	}
 
 	//Make a "Load< T >" behave like a "T const *":
@@ -73,8 +108,8 @@ struct Load {
 template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+	Load( LoadTag tag, const std::function< void() > &load_fn, std::string const &name = "") {
+		add_load_function(tag, load_fn, name);
 	}
 };
 
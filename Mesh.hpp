@@ -10,9 +10,11 @@
  */
 
 #include "GL.hpp"
+#include "read_write_chunk.hpp"
 #include <glm/glm.hpp>
 #include <map>
 #include <limits>
+#include <memory>
 #include <string>
 
 
@@ -34,6 +36,12 @@ struct MeshBuffer {
 	// note: will throw if file fails to read.
 	MeshBuffer(std::string const &filename);
 
+	//construct from a file without touching OpenGL (so it can happen on a loading thread);
+	// call upload() later, on the main thread, to create 'buffer':
+	enum DeferUploadTag { DeferUpload };
+	MeshBuffer(std::string const &filename, DeferUploadTag);
+	void upload();
+
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
 	const Mesh &lookup(std::string const &name) const;
@@ -50,6 +58,20 @@ struct MeshBuffer {
 	//used by the lookup() function:
 	std::map< std::string, Mesh > meshes;
 
+	//vertex format of '.pnct' files:
+	struct Vertex {
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::u8vec4 Color;
+		glm::vec2 TexCoord;
+	};
+	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+	//vertex data read by the DeferUpload constructor, waiting for upload():
+	// (points into the still-mapped file, so upload() copies straight from the file to the GPU)
+	std::unique_ptr< ChunkFile > pending_file;
+	ChunkSpan< Vertex > pending_upload;
+
 	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
 		GLint size = 0;
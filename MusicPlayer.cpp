@@ -0,0 +1,195 @@
+#include "MusicPlayer.hpp"
+
+#include "OpusStream.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <thread>
+
+namespace {
+	constexpr float const AudioRate = 48000.0f; //(Sound mixes at 48kHz)
+
+	//fades are sent to the mixer as short linear ramps that follow the curve, each aimed 'Step' seconds ahead:
+	constexpr float const Step = 0.05f;
+
+	bool is_ready(std::future< std::unique_ptr< Sound::Sample > > const &future) {
+		return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+}
+
+float MusicPlayer::Track::gain(uint64_t now) const {
+	if (now >= fade_begin + fade_frames) return to;
+	float t = float(now - fade_begin) / float(fade_frames);
+	float angle = t * 1.5707963f; //(quarter turn)
+	return from * std::cos(angle) + to * std::sin(angle);
+}
+
+void MusicPlayer::Track::fade(float to_, float seconds, uint64_t now) {
+	from = gain(now);
+	to = to_;
+	fade_begin = now;
+	fade_frames = uint64_t(std::max(0.0f, seconds) * AudioRate);
+	fading = true;
+}
+
+MusicPlayer::MusicPlayer(Sound::Group group_) : group(group_) {
+}
+
+MusicPlayer::~MusicPlayer() {
+	pending = false;
+	if (current) retire_current(0.0f);
+	for (auto &track : retiring) {
+		track->playing.stop();
+	}
+
+	//samples must outlive their playback, so wait for the mixer to stop the voices:
+	// (giving up if the audio clock stops advancing -- then nothing is mixing them)
+	uint64_t clock = Sound::audio_clock();
+	auto progress = std::chrono::steady_clock::now();
+	while (std::any_of(retiring.begin(), retiring.end(), [](std::unique_ptr< Track > const &track) { return !track->playing.stopped(); })) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		auto now = std::chrono::steady_clock::now();
+		if (Sound::audio_clock() != clock) {
+			clock = Sound::audio_clock();
+			progress = now;
+		} else if (now - progress > std::chrono::milliseconds(250)) {
+			std::cerr << "WARNING: audio stopped while music was playing; freeing music tracks anyway." << std::endl;
+			break;
+		}
+	}
+	//(any background loads finish as the futures are destroyed)
+}
+
+void MusicPlayer::set_playlist(std::vector< std::string > const &filenames) {
+	playlist = filenames;
+	pending = false;
+	if (loading.valid()) abandoned.emplace_back(std::move(loading));
+	loading_index = -1U;
+}
+
+void MusicPlayer::play(uint32_t index, float fade) {
+	if (playlist.empty()) {
+		std::cerr << "WARNING: music player has an empty playlist; nothing to play." << std::endl;
+		return;
+	}
+	index %= uint32_t(playlist.size());
+	load(index);
+	pending = true;
+	pending_fade = fade;
+}
+
+void MusicPlayer::next(float fade) {
+	//(after the track waiting to start, if there is one)
+	uint32_t index = (pending ? loading_index : current_index());
+	play(index + 1, fade); //(-1U + 1 is entry 0)
+}
+
+void MusicPlayer::stop(float fade) {
+	pending = false;
+	if (current) retire_current(fade);
+}
+
+uint32_t MusicPlayer::current_index() const {
+	return (current ? current->index : -1U);
+}
+
+void MusicPlayer::update() {
+	uint64_t now = Sound::audio_clock();
+
+	//forget unwanted loads once they have finished:
+	abandoned.erase(std::remove_if(abandoned.begin(), abandoned.end(), is_ready), abandoned.end());
+
+	//start the requested track once it has loaded:
+	if (pending && is_ready(loading)) {
+		pending = false;
+		uint32_t index = loading_index;
+		loading_index = -1U;
+		std::unique_ptr< Sound::Sample > sample;
+		try {
+			sample = loading.get();
+		} catch (std::exception &e) {
+			std::cerr << "WARNING: music track '" << playlist[index] << "' failed to load: " << e.what() << std::endl;
+		}
+		if (sample) start_track(std::move(sample), index, pending_fade);
+	}
+
+	//crossfade into the next track as the current one ends:
+	// (unless it loops, or another track has been asked for already)
+	if (current && !current->looping && !current->advanced && !pending && !playlist.empty()) {
+		uint64_t length = current->sample->stream->length;
+		uint64_t fade_frames = uint64_t(std::max(0.0f, crossfade) * AudioRate);
+		//(if the file didn't give its length, wait for it to run out)
+		bool ending = (length != 0 ? now + fade_frames >= current->started + length : current->playing.stopped());
+		if (ending) {
+			current->advanced = true;
+			play(current->index + 1, crossfade);
+		}
+	}
+
+	//step fades:
+	auto step_fade = [now](Track &track) {
+		if (!track.fading) return;
+		track.playing.set_volume(track.gain(now + uint64_t(Step * AudioRate)), Step);
+		if (now >= track.fade_begin + track.fade_frames) track.fading = false;
+	};
+	if (current) step_fade(*current);
+	for (auto &track : retiring) {
+		step_fade(*track);
+		if (!track->fading && !track->stopping) {
+			track->playing.stop(Step);
+			track->stopping = true;
+		}
+	}
+
+	//free tracks the mixer has finished with:
+	retiring.erase(std::remove_if(retiring.begin(), retiring.end(), [](std::unique_ptr< Track > const &track) {
+		return track->playing.stopped();
+	}), retiring.end());
+}
+
+void MusicPlayer::load(uint32_t index) {
+	if (loading.valid() && loading_index == index) return; //already loading (or preloaded)
+	if (loading.valid()) abandoned.emplace_back(std::move(loading));
+	loading_index = index;
+	std::string filename = playlist[index];
+	//opening the file and decoding its first few seconds happens on its own thread:
+	loading = std::async(std::launch::async, [filename]() {
+		return std::make_unique< Sound::Sample >(filename, Sound::Sample::Streamed);
+	});
+}
+
+void MusicPlayer::start_track(std::unique_ptr< Sound::Sample > &&sample, uint32_t index, float fade) {
+	uint64_t now = Sound::audio_clock();
+	if (current) retire_current(fade);
+
+	auto track = std::make_unique< Track >();
+	track->sample = std::move(sample);
+	track->index = index;
+	//(playback actually starts with the next mix block, a little after 'now' -- close enough for timing the next crossfade)
+	track->started = now;
+	if (fade > 0.0f) {
+		track->to = 0.0f; //(so the fade in starts from silence)
+		track->fade(1.0f, fade, now);
+	}
+	track->looping = loop_tracks;
+	if (track->looping) {
+		track->playing = Sound::loop(*track->sample, track->gain(now), 0.0f, group);
+	} else {
+		track->playing = Sound::play(*track->sample, track->gain(now), 0.0f, group);
+	}
+	current = std::move(track);
+
+	//open the next entry now, so advancing to it doesn't have to wait:
+	// (unless this track loops -- then there's no telling when, or to which entry, it will change;
+	//  next() and play() open their track when asked, rather than keep a second stream open meanwhile)
+	if (!current->looping) load((index + 1) % uint32_t(playlist.size()));
+}
+
+void MusicPlayer::retire_current(float fade) {
+	current->fade(0.0f, fade, Sound::audio_clock());
+	current->advanced = true;
+	retiring.emplace_back(std::move(current));
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+/*
+ * MusicPlayer plays a playlist of '.opus' music tracks, crossfading from one to the next:
+ *
+ * MusicPlayer music(music_group);
+ * music.set_playlist({ data_path("title.opus"), data_path("level.opus") });
+ * music.play(0);
+ * //every frame (game thread):
+ * music.update();
+ * //later, e.g. when the level starts:
+ * music.next();
+ *
+ * Tracks are streamed (see OpusStream.hpp), so each costs only its stream buffer rather than the whole
+ * decoded song -- even while two are crossfading. Tracks are opened on a background thread, so changing
+ * tracks doesn't stall the game thread; while a track plays once through, the next entry is opened ahead
+ * of time so the crossfade into it starts on time. (A looping track doesn't preload anything -- next() and
+ * play() open their track when called, starting it a moment later.)
+ *
+ * Crossfades are equal-power (the outgoing track fades along a cosine, the incoming along a sine),
+ * so the overall loudness holds steady through the fade.
+ *
+ * With 'loop_tracks', each track loops gaplessly -- between its LOOPSTART and LOOPEND (or LOOPLENGTH) tags
+ * if it has them, otherwise over the whole file -- until next() or play() is called. Otherwise each track
+ * plays once and crossfades into the next playlist entry as it ends (wrapping around at the end of the list).
+ *
+ */
+
+#include "Sound.hpp"
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct MusicPlayer {
+	//tracks play in 'group':
+	MusicPlayer(Sound::Group group = Sound::master);
+	//stops playback, waiting (briefly) for the mixer to finish with the tracks:
+	// (so destroy the player while the mixer is running, not between Sound::shutdown() and a later Sound::init())
+	~MusicPlayer();
+
+	MusicPlayer(MusicPlayer const &) = delete;
+	MusicPlayer &operator=(MusicPlayer const &) = delete;
+
+	//set the tracks to play (filenames of '.opus' files); doesn't change what is playing now,
+	// but cancels a play() still waiting for its track to load:
+	void set_playlist(std::vector< std::string > const &filenames);
+
+	//crossfade (over 'fade' seconds) from whatever is playing to playlist entry 'index':
+	// (playback starts once the track has been opened -- right away, if it was already preloaded)
+	void play(uint32_t index, float fade = 2.0f);
+	//crossfade to the playlist entry after the current one:
+	void next(float fade = 2.0f);
+	//fade out whatever is playing:
+	void stop(float fade = 2.0f);
+
+	//call once per frame (from the game thread): starts tracks that have finished loading,
+	// advances through the playlist, and steps the crossfade volumes:
+	void update();
+
+	//loop each track until told to change (otherwise, advance through the playlist):
+	// (applies to tracks started after it is set)
+	bool loop_tracks = false;
+	//length of the crossfade between tracks when advancing through the playlist, in seconds:
+	float crossfade = 2.0f;
+
+	//playlist entry playing (or fading in) now, or -1U if none:
+	uint32_t current_index() const;
+
+	//--- internals ---
+	Sound::Group group;
+	std::vector< std::string > playlist;
+
+	//a track that is playing:
+	struct Track {
+		std::unique_ptr< Sound::Sample > sample; //(streamed)
+		Sound::PlayingSample playing;
+		uint32_t index = -1U; //playlist entry
+		uint64_t started = 0; //audio frame playback started (roughly -- see start_track())
+		bool looping = false; //(looping tracks don't advance to the next entry by themselves)
+		bool advanced = false; //has the next track been requested (so a failed load doesn't retry every frame)?
+		//volume fades along an equal-power curve from 'from' to 'to' over audio frames [fade_begin, fade_begin + fade_frames):
+		float from = 1.0f, to = 1.0f;
+		uint64_t fade_begin = 0;
+		uint64_t fade_frames = 0;
+		bool fading = false; //does update() still need to send volume changes?
+		bool stopping = false; //(retiring tracks) has the fade out finished and the voice been stopped?
+		float gain(uint64_t now) const; //volume at audio frame 'now'
+		void fade(float to, float seconds, uint64_t now);
+	};
+	std::unique_ptr< Track > current;
+	std::vector< std::unique_ptr< Track > > retiring; //fading out, then waiting for their voices to stop
+
+	//track being opened in the background:
+	std::future< std::unique_ptr< Sound::Sample > > loading;
+	uint32_t loading_index = -1U;
+	//once it has loaded, should it start playing (rather than wait, preloaded, for its turn)?
+	bool pending = false;
+	float pending_fade = 0.0f;
+	//loads nobody wants anymore, kept until they finish (since destroying a running std::async future waits for it):
+	std::vector< std::future< std::unique_ptr< Sound::Sample > > > abandoned;
+
+	void load(uint32_t index); //start opening playlist entry 'index' (if it isn't already)
+	void start_track(std::unique_ptr< Sound::Sample > &&sample, uint32_t index, float fade);
+	void retire_current(float fade);
+};
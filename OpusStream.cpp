@@ -0,0 +1,213 @@
+#include "OpusStream.hpp"
+
+#include <opusfile.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+OpusStream::OpusStream(std::string const &filename_) : filename(filename_), op(nullptr, op_free) {
+	int err = 0;
+	op.reset(op_open_file(filename.c_str(), &err));
+	if (err != 0 || !op) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+	}
+	buffer.reset(new float[Capacity]);
+
+	ogg_int64_t total = op_pcm_total(op.get(), -1);
+	if (total > 0) length = uint64_t(total);
+
+	//loop points (see OpusStream.hpp):
+	if (OpusTags const *tags = op_tags(op.get(), -1)) {
+		//helper: read a numeric tag, if present:
+		auto get_tag = [&](char const *name, uint64_t *value) {
+			char const *text = opus_tags_query(tags, name, 0);
+			if (!text) return false;
+			char *end = nullptr;
+			*value = std::strtoull(text, &end, 10);
+			if (end == text) {
+				std::cerr << "WARNING: ignoring non-numeric " << name << " tag \"" << text << "\" in '" << filename << "'." << std::endl;
+				return false;
+			}
+			return true;
+		};
+		uint64_t start = 0, end = 0, loop_length = 0;
+		bool has_start = get_tag("LOOPSTART", &start);
+		bool has_end = get_tag("LOOPEND", &end);
+		if (!has_end && get_tag("LOOPLENGTH", &loop_length)) {
+			end = start + loop_length;
+			has_end = true;
+		}
+		if (has_start || has_end) {
+			if (!has_end) end = length; //(loop to the end of the file)
+			if ((end != 0 && start >= end) || (length != 0 && end > length)) {
+				std::cerr << "WARNING: ignoring loop points [" << start << ", " << end << ") outside of '" << filename << "' (" << length << " samples long)." << std::endl;
+			} else {
+				loop_start = start;
+				loop_end = end;
+			}
+		}
+	}
+
+	std::cout << "streaming '" << filename << "'." << std::endl;
+
+	//decoder starts filling the buffer right away, so the first restart() has samples ready:
+	decoder = std::thread(&OpusStream::decode, this);
+}
+
+OpusStream::~OpusStream() {
+	{
+		std::lock_guard< std::mutex > guard(mutex);
+		quit = true;
+	}
+	wake.notify_one();
+	decoder.join();
+}
+
+uint32_t OpusStream::restart(bool loop_) {
+	loop.store(loop_, std::memory_order_relaxed);
+	uint32_t serial = requested.fetch_add(1, std::memory_order_release) + 1; //(release publishes 'loop')
+	{ //(taking the mutex means the decoder can't miss this wake-up between checking and waiting)
+		std::lock_guard< std::mutex > guard(mutex);
+	}
+	wake.notify_one();
+	return serial;
+}
+
+uint32_t OpusStream::peek(uint32_t serial, float const **data, uint32_t max_count) {
+	assert(data);
+	if (acknowledged.load(std::memory_order_acquire) != serial) return 0; //decoder hasn't caught up to this restart yet
+
+	if (playing != serial) {
+		//first read of this playback: skip anything decoded before it began:
+		read.store(restart_at.load(std::memory_order_relaxed), std::memory_order_release);
+		playing = serial;
+	}
+
+	uint32_t r = read.load(std::memory_order_relaxed);
+	uint32_t available = write.load(std::memory_order_acquire) - r;
+	uint32_t offset = r & (Capacity - 1);
+	*data = buffer.get() + offset;
+	return std::min(std::min(available, max_count), Capacity - offset);
+}
+
+void OpusStream::consume(uint32_t count) {
+	uint32_t r = read.load(std::memory_order_relaxed) + count;
+	read.store(r, std::memory_order_release);
+	//wake the decoder if it is waiting for room and there's now enough to be worth filling:
+	// (notify_one doesn't take the mutex, so can't block the audio thread; it runs once per Refill samples at most)
+	if (wants_room.load(std::memory_order_relaxed)
+	 && Capacity - (write.load(std::memory_order_relaxed) - r) >= Refill
+	 && wants_room.exchange(false, std::memory_order_acq_rel)) {
+		wake.notify_one();
+	}
+}
+
+bool OpusStream::finished(uint32_t serial) {
+	if (requested.load(std::memory_order_acquire) != serial) return true; //replaced by a newer playback
+	if (playing != serial) return false; //not started yet
+	return ended.load(std::memory_order_acquire)
+		&& read.load(std::memory_order_relaxed) == ended_at.load(std::memory_order_relaxed);
+}
+
+void OpusStream::decode() {
+	uint32_t handled = 0; //latest restart request this thread has acknowledged
+	uint64_t position = 0; //frame of the file that the decoder reads next
+
+	//helper: jump to frame 'frame' of the file:
+	auto seek = [this,&position](uint64_t frame) {
+		int ret = op_pcm_seek(op.get(), ogg_int64_t(frame));
+		if (ret != 0) {
+			std::cerr << "WARNING: opusfile error " << ret << " seeking in '" << filename << "'; stopping stream." << std::endl;
+			ended_at.store(write.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			ended.store(true, std::memory_order_release);
+			return false;
+		}
+		position = frame;
+		ended.store(false, std::memory_order_relaxed);
+		return true;
+	};
+
+	std::vector< float > pcm(2 * 5760); //room for the largest (120ms) opus frame, in stereo
+
+	std::unique_lock< std::mutex > lock(mutex);
+	while (!quit) {
+		lock.unlock();
+		bool progress = false;
+		bool looping = loop.load(std::memory_order_relaxed);
+
+		//start over if a new playback was requested:
+		uint32_t request = requested.load(std::memory_order_acquire);
+		if (request != handled) {
+			looping = loop.load(std::memory_order_relaxed); //(acquire above makes this the requested playback's value)
+			uint32_t w = write.load(std::memory_order_relaxed);
+			if (read.load(std::memory_order_acquire) == restart_at.load(std::memory_order_relaxed)
+			 && !(looping && loop_end != 0 && position > loop_end)) {
+				//nothing was played since the last restart, so the buffer already starts at the beginning of the file
+				// (and, if this playback loops, hasn't gone past the loop end):
+				if (ended.load(std::memory_order_relaxed) && looping) {
+					seek(loop_start); //(continue past a previously-reached end, since this playback loops)
+				}
+			} else {
+				seek(0);
+				restart_at.store(w, std::memory_order_relaxed);
+			}
+			handled = request;
+			acknowledged.store(request, std::memory_order_release);
+			progress = true;
+		}
+
+		if (!ended.load(std::memory_order_relaxed)) {
+			uint32_t w = write.load(std::memory_order_relaxed);
+			uint32_t space = Capacity - (w - read.load(std::memory_order_acquire));
+			uint32_t want = std::min< uint32_t >(space, uint32_t(pcm.size() / 2));
+			if (looping && loop_end != 0) {
+				//stop exactly at the loop end (opusfile keeps the rest of a partly-read frame for the next read):
+				want = uint32_t(std::min< uint64_t >(want, loop_end - std::min(position, loop_end)));
+			}
+			if (looping && loop_end != 0 && position >= loop_end) {
+				//reached the loop end; wrap around without a gap:
+				progress = seek(loop_start);
+			} else if (want > 0) {
+				int ret = op_read_float_stereo(op.get(), pcm.data(), int(2 * want));
+				if (ret > 0) {
+					//downmix to mono by averaging:
+					for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+						buffer[(w + i) & (Capacity - 1)] = (pcm[2*i] + pcm[2*i+1]) * 0.5f;
+					}
+					write.store(w + uint32_t(ret), std::memory_order_release);
+					position += uint32_t(ret);
+					progress = true;
+				} else if (ret == 0 && looping) {
+					//end of file; wrap around without a gap:
+					progress = seek(loop_start);
+				} else {
+					if (ret < 0) {
+						std::cerr << "WARNING: opusfile read error " << ret << " streaming '" << filename << "'; stopping stream." << std::endl;
+					}
+					ended_at.store(w, std::memory_order_relaxed);
+					ended.store(true, std::memory_order_release);
+				}
+			}
+		}
+
+		lock.lock();
+		if (!progress && !quit) {
+			if (ended.load(std::memory_order_relaxed)) {
+				//file has ended: nothing to do until restarted (restart() signals with the mutex held, so this can't miss it):
+				wake.wait(lock);
+			} else {
+				//buffer is full: sleep until consume() has made room.
+				// (consume() signals without the mutex, so its wake-up can land between setting 'wants_room' and waiting;
+				//  the timeout covers that case, and is far shorter than the buffer takes to drain)
+				wants_room.store(true, std::memory_order_release);
+				wake.wait_for(lock, std::chrono::milliseconds(250));
+				wants_room.store(false, std::memory_order_relaxed);
+			}
+		}
+	}
+}
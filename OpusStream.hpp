@@ -0,0 +1,89 @@
+#pragma once
+
+/*
+ * OpusStream decodes an '.opus' file a little at a time on a background thread,
+ * keeping a fixed-size buffer of 48kHz mono samples ready for the audio callback.
+ *
+ * This is what backs a Sound::Sample loaded in 'Streamed' mode: long music costs
+ * only the buffer (256KB) instead of the whole decoded file, and loading doesn't
+ * wait for decoding.
+ *
+ * Threads:
+ *  - the game thread calls restart() to begin a new playback;
+ *  - the audio thread calls peek()/consume()/finished() for that playback;
+ *  - the decoder thread (owned by the stream) fills the buffer.
+ * Only one playback can read the stream at a time; restarting takes it over.
+ *
+ * Looping playback wraps at the loop points given by the file's tags, if it has them:
+ *  LOOPSTART, and either LOOPEND or LOOPLENGTH, in 48kHz frames from the start of the file
+ *  (the usual convention for game music with an intro). Otherwise the whole file loops.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct OggOpusFile;
+
+struct OpusStream {
+	//open file (throws on error) and start decoding from the beginning:
+	OpusStream(std::string const &filename);
+	//stop the decoder thread and close the file:
+	~OpusStream();
+
+	OpusStream(OpusStream const &) = delete;
+	OpusStream &operator=(OpusStream const &) = delete;
+
+	//(game thread) start playback from the beginning; 'loop' wraps from loop_end back to loop_start
+	// (seamlessly, via op_pcm_seek) instead of ending. Returns a serial number identifying the playback:
+	uint32_t restart(bool loop);
+
+	//(audio thread) get the contiguous run of decoded samples ready for playback 'serial':
+	// returns the count (at most 'max_count'; zero if nothing is ready) and sets *data to point at them.
+	uint32_t peek(uint32_t serial, float const **data, uint32_t max_count);
+	//(audio thread) mark 'count' samples (from a previous peek()) as played:
+	void consume(uint32_t count);
+	//(audio thread) has playback 'serial' reached the end of the file, or been replaced by a newer restart()?
+	bool finished(uint32_t serial);
+
+	//buffer size, in samples; must be a power of two:
+	static constexpr uint32_t const Capacity = 65536;
+
+	//file length, in samples (0 if the file doesn't say):
+	uint64_t length = 0;
+	//looping playback plays [0, loop_end) once, then [loop_start, loop_end) over and over:
+	// (set from the file's tags; loop_end is 0 when the file has no loop points, meaning the end of the file)
+	uint64_t loop_start = 0;
+	uint64_t loop_end = 0;
+
+	//--- internals ---
+	std::string filename;
+	std::unique_ptr< OggOpusFile, void (*)(OggOpusFile *) > op;
+	std::unique_ptr< float[] > buffer; //'Capacity' samples
+
+	//buffer positions are free-running counters, masked on access:
+	std::atomic< uint32_t > write{0}; //next sample the decoder writes (written by decoder)
+	std::atomic< uint32_t > read{0}; //next sample the audio thread plays (written by audio thread)
+
+	std::atomic< uint32_t > requested{0}; //serial of the latest restart() (written by game thread)
+	std::atomic< uint32_t > acknowledged{0}; //serial the decoder has restarted for (written by decoder)
+	std::atomic< uint32_t > restart_at{0}; //'write' position where the acknowledged playback starts
+	std::atomic< bool > loop{false}; //should the decoder wrap to the start at the end of the file?
+	std::atomic< bool > ended{false}; //has the decoder reached the end of the file (and not looped)?
+	std::atomic< uint32_t > ended_at{0}; //'write' position of the end of the file, if ended
+	uint32_t playing = 0; //serial the audio thread is currently reading (audio thread only)
+
+	//decoder thread and its wake-up signal:
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool quit = false; //protected by mutex
+	//the decoder sleeps while the buffer is full; consume() wakes it once this many samples are free:
+	static constexpr uint32_t const Refill = Capacity / 4;
+	std::atomic< bool > wants_room{false}; //is the decoder asleep waiting for room? (cleared by whoever wakes it)
+	std::thread decoder;
+	void decode(); //decoder thread main loop
+};
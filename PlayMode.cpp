@@ -7,6 +7,7 @@
 #include "Load.hpp"
 #include "gl_errors.hpp"
 #include "data_path.hpp"
+#include "SampleCache.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
@@ -15,15 +16,21 @@
 #include <math.h>
 #include <array>
 #include <cassert>
+#include <cstdio>
+
+//Loads are split so that file reading + decoding happens on worker threads (see Load.hpp);
+// an empty second stage means there is nothing left to do on the main thread.
 
 GLuint hexapod_meshes_for_lit_color_texture_program = 0;
-Load< MeshBuffer > hexapod_meshes(LoadTagDefault, []() -> MeshBuffer const * {
-	MeshBuffer const *ret = new MeshBuffer(data_path("scene.pnct"));
+Load< MeshBuffer > hexapod_meshes(LoadTagDefault, []() -> MeshBuffer * {
+	return new MeshBuffer(data_path("scene.pnct"), MeshBuffer::DeferUpload);
+}, [](MeshBuffer *ret) {
+	ret->upload();
 	hexapod_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
-	return ret;
-});
+}, "scene.pnct");
 
-Load< Scene > hexapod_scene(LoadTagDefault, []() -> Scene const * {
+//(scene is 'Late' because it looks up meshes from hexapod_meshes)
+Load< Scene > hexapod_scene(LoadTagLate, []() -> Scene * {
 	return new Scene(data_path("scene.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 		Mesh const &mesh = hexapod_meshes->lookup(mesh_name);
 
@@ -37,25 +44,22 @@ Load< Scene > hexapod_scene(LoadTagDefault, []() -> Scene const * {
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
 
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
+
 	});
-});
-
-Load< Sound::Sample > background_sample(LoadTagDefault, []() -> Sound::Sample const * {
-	return new Sound::Sample(data_path("Funshine.wav"));
-});
-
-Load< Sound::Sample > zombie_sample_1(LoadTagDefault, []() -> Sound::Sample const * {
-	return new Sound::Sample(data_path("zombie_1.opus"));
-});
-Load< Sound::Sample > zombie_sample_2(LoadTagDefault, []() -> Sound::Sample const * {
-	return new Sound::Sample(data_path("zombie_2.opus"));
-});
-Load< Sound::Sample > human_sample_1(LoadTagDefault, []() -> Sound::Sample const * {
-	return new Sound::Sample(data_path("human_1.opus"));
-});
-Load< Sound::Sample > human_sample_2(LoadTagDefault, []() -> Sound::Sample const * {
-	return new Sound::Sample(data_path("human_2.opus"));
-});
+}, {}, "scene.scene");
+
+//samples come from the shared cache (see SampleCache.hpp), so other modes using the same files don't load them again:
+//the many looping entity voices use compact encodings (see Sound::Sample::Encoding):
+// (one sample per character; each entity plays it at its own rate -- see update_sound() -- rather than loading variants)
+//these hold references to the cached samples, so evicting them from the cache doesn't free them:
+Load< std::shared_ptr< Sound::Sample const > > zombie_sample_1(LoadTagDefault, []() -> std::shared_ptr< Sound::Sample const > * {
+	return new std::shared_ptr< Sound::Sample const >(Sound::get_sample(data_path("zombie_1.opus"), Sound::Sample::Decoded, Sound::Sample::ADPCM));
+}, {}, "zombie_1.opus");
+Load< std::shared_ptr< Sound::Sample const > > human_sample_2(LoadTagDefault, []() -> std::shared_ptr< Sound::Sample const > * {
+	return new std::shared_ptr< Sound::Sample const >(Sound::get_sample(data_path("human_2.opus"), Sound::Sample::Decoded, Sound::Sample::Int16));
+}, {}, "human_2.opus");
 
 PlayMode::PlayMode() : scene(*hexapod_scene) {
 	for (auto &transform : scene.transforms) {
@@ -99,8 +103,14 @@ PlayMode::PlayMode() : scene(*hexapod_scene) {
 	camera = &scene.cameras.front();
 	camera->init_camera(player->transform->position);
 
-	// start background music 
-	Sound::loop(*background_sample, 0.1f, 0.0f);
+	music_group = Sound::add_group(Sound::master, 0.1f);
+	voices_group = Sound::add_group();
+
+	// start background music (the player opens it in the background, and loops it at its loop points, if tagged)
+	music.reset(new MusicPlayer(music_group));
+	music->loop_tracks = true;
+	music->set_playlist({ data_path("dusty-floor.opus") });
+	music->play(0, 0.0f);
 }
 
 PlayMode::~PlayMode() {
@@ -155,6 +165,10 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 		} else if (evt.key.keysym.sym == SDLK_SPACE) {
 			space.pressed = true;
 			return true;
+		} else if (evt.key.keysym.sym == SDLK_BACKQUOTE) {
+			show_audio_stats = !show_audio_stats;
+			audio_stats_age = std::numeric_limits< float >::infinity(); //(refresh right away)
+			return true;
 		}
 	} else if (evt.type == SDL_KEYUP) {
 		if (evt.key.keysym.sym == SDLK_a) {
@@ -286,20 +300,24 @@ void PlayMode::update_sound() {
 									glm::vec3(player_offset.x*3.0f, player_offset.y*3.0f, 
 									player->transform->position.z);
 			float volume = 1.0f;
+			//vary pitch a little from tile to tile, so a crowd doesn't sound like copies of one voice:
+			float rate = 0.88f + 0.06f * float((i * 7 + j * 3) % 5);
 			if ((std::abs(player_offset.x) >= 2) || (std::abs(player_offset.y) >= 2)) {
 				volume = 0.0f;
 			}
 			if (tile->entity->character == Character::human && !tile->counted) {
-				if (tile->entity->sound == nullptr) {
-					tile->entity->sound = Sound::loop_3D(*human_sample_2, volume, sound_position, 1.5f);
+				if (tile->entity->sound.stopped()) { //(not started yet, or voice was stolen)
+					tile->entity->sound = Sound::loop_3D(**human_sample_2, volume, sound_position, 1.5f, voices_group);
+					tile->entity->sound->set_rate(rate, 0.0f);
 				} else {
 					tile->entity->sound->set_position(sound_position);
 					tile->entity->sound->set_volume(volume);
 				}
 				
 			} else if (tile->entity->character == Character::zombie && !tile->counted) {
-				if (tile->entity->sound == nullptr) {
-					tile->entity->sound = Sound::loop_3D(*zombie_sample_1, volume, sound_position, 1.5f);
+				if (tile->entity->sound.stopped()) { //(not started yet, or voice was stolen)
+					tile->entity->sound = Sound::loop_3D(**zombie_sample_1, volume, sound_position, 1.5f, voices_group);
+					tile->entity->sound->set_rate(rate, 0.0f);
 				} else {
 					tile->entity->sound->set_position(sound_position);
 					tile->entity->sound->set_volume(volume);
@@ -324,6 +342,16 @@ void PlayMode::update_direction(Entity *character) {
 }
 
 void PlayMode::update(float elapsed) {
+	music->update();
+
+	if (show_audio_stats) {
+		audio_stats_age += elapsed;
+		if (audio_stats_age >= 0.5f) {
+			audio_stats = Sound::timing();
+			audio_stats_age = 0.0f;
+		}
+	}
+
 	if (game_over) {
 		return;
 	}
@@ -590,6 +618,51 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 				glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 				glm::u8vec4(0xff, 0xff, 0x00, 0x00));
 		}
+
+		if (show_audio_stats) {
+			Sound::Timing const &t = audio_stats;
+			auto fixed = [](float value, int digits) {
+				char buf[32];
+				std::snprintf(buf, sizeof(buf), "%.*f", digits, double(value));
+				return std::string(buf);
+			};
+			std::vector< std::string > text{
+				"Audio: " + std::to_string(t.block_size) + " frame blocks (" + fixed(t.budget_ms, 2) + " ms)",
+				"mix " + fixed(t.average_ms, 2) + " ms avg, " + fixed(t.max_ms, 2) + " ms max; " + std::to_string(t.overruns) + " overruns, " + std::to_string(t.late) + " late",
+				"voices: " + std::to_string(t.voices_mixed) + " mixed, " + std::to_string(t.voices_virtual) + " virtual, " + std::to_string(t.voices_held) + " held, " + std::to_string(t.voices_stopped) + " stopped",
+				"peak " + fixed(t.peak, 3) + ", " + std::to_string(t.clipped) + " samples clipped",
+			};
+			constexpr float SH = 0.06f; //(smaller text than the rest of the overlay)
+			float y = 1.0f - 2.5f * H;
+			for (auto const &line : text) {
+				y -= 1.2f * SH;
+				lines.draw_text(line,
+					glm::vec3(-aspect + 0.1f * H, y, 0.0),
+					glm::vec3(SH, 0.0f, 0.0f), glm::vec3(0.0f, SH, 0.0f),
+					glm::u8vec4(0x00, 0x00, 0x00, 0x00));
+				lines.draw_text(line,
+					glm::vec3(-aspect + 0.1f * H + ofs, y + ofs, 0.0),
+					glm::vec3(SH, 0.0f, 0.0f), glm::vec3(0.0f, SH, 0.0f),
+					glm::u8vec4(0xff, 0xff, 0xff, 0x00));
+			}
+
+			//histogram of mixing time (tenths of the budget; the last bar is over budget):
+			uint32_t most = 1;
+			for (uint32_t count : t.histogram) most = std::max(most, count);
+			float const bar = 0.04f;
+			float const tall = 0.2f;
+			glm::vec2 origin(-aspect + 0.1f * H, y - 0.5f * SH - tall);
+			for (uint32_t b = 0; b < Sound::Timing::Buckets; ++b) {
+				float x0 = origin.x + b * bar;
+				float x1 = x0 + 0.8f * bar;
+				float y1 = origin.y + tall * float(t.histogram[b]) / float(most);
+				glm::u8vec4 color = (b + 1 < Sound::Timing::Buckets ? glm::u8vec4(0x00, 0xff, 0x00, 0xff) : glm::u8vec4(0xff, 0x00, 0x00, 0xff));
+				lines.draw(glm::vec3(x0, origin.y, 0.0f), glm::vec3(x0, y1, 0.0f), color);
+				lines.draw(glm::vec3(x0, y1, 0.0f), glm::vec3(x1, y1, 0.0f), color);
+				lines.draw(glm::vec3(x1, y1, 0.0f), glm::vec3(x1, origin.y, 0.0f), color);
+			}
+			lines.draw(glm::vec3(origin.x, origin.y, 0.0f), glm::vec3(origin.x + Sound::Timing::Buckets * bar, origin.y, 0.0f));
+		}
 	}
 	GL_ERRORS();
 }
@@ -2,10 +2,12 @@
 
 #include "Scene.hpp"
 #include "Sound.hpp"
+#include "MusicPlayer.hpp"
 
 #include <glm/glm.hpp>
 
 #include <vector>
+#include <memory>
 #include <deque>
 #include <map>
 
@@ -45,7 +47,7 @@ struct PlayMode : Mode {
 		Scene::Transform *transform = nullptr;
 		Character character = none;
 		Tile* tile = nullptr;
-		std::shared_ptr< Sound::PlayingSample > sound = nullptr;
+		Sound::PlayingSample sound;
 		bool rotated = false;
 	};
 
@@ -79,6 +81,17 @@ struct PlayMode : Mode {
 	std::vector<Entity *> humans;
 	std::vector<Entity *> zombies;
 
+	// mixer groups: background music, and the characters' voices
+	Sound::Group music_group;
+	Sound::Group voices_group;
+	// background music (streamed, in music_group):
+	std::unique_ptr< MusicPlayer > music;
+
+	// audio mixer stats overlay (toggled with the backquote key), refreshed a couple of times a second:
+	bool show_audio_stats = false;
+	float audio_stats_age = 0.0f;
+	Sound::Timing audio_stats;
+
 	// maps two coords to a tile
 	std::map<std::pair<int8_t, int8_t>, Tile *> board; 
 
@@ -0,0 +1,44 @@
+#pragma once
+
+/*
+ * A RingBuffer is a fixed-capacity, single-producer/single-consumer queue.
+ *
+ * Exactly one thread may call push() and exactly one (other) thread may call pop();
+ * neither side ever blocks or takes a lock, which makes this suitable for
+ * handing data to (or from) the audio callback.
+ *
+ */
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+template< typename T, uint32_t Capacity >
+struct RingBuffer {
+	static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "RingBuffer capacity must be a power of two.");
+
+	//producer side: add a value to the queue; returns false (and leaves value alone) if the queue is full:
+	bool push(T &&value) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == Capacity) return false;
+		slots[h & (Capacity - 1)] = std::move(value);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	//consumer side: remove the oldest value from the queue; returns false if the queue is empty:
+	bool pop(T *value) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (head.load(std::memory_order_acquire) == t) return false;
+		*value = std::move(slots[t & (Capacity - 1)]);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	//internals:
+	std::array< T, Capacity > slots;
+	//head/tail are free-running counters (only masked on access); kept on separate cache lines so producer and consumer don't fight:
+	alignas(64) std::atomic< uint32_t > head{0}; //next slot to write (written by producer)
+	alignas(64) std::atomic< uint32_t > tail{0}; //next slot to read (written by consumer)
+};
@@ -0,0 +1,104 @@
+#include "SampleCache.hpp"
+
+#include <chrono>
+#include <future>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace {
+	struct Key {
+		std::string filename;
+		Sound::Sample::LoadMode mode;
+		Sound::Sample::Encoding encoding;
+		bool operator<(Key const &o) const {
+			return std::tie(filename, mode, encoding) < std::tie(o.filename, o.mode, o.encoding);
+		}
+	};
+
+	//entries hold a future, so that requests that arrive during a load can wait for it:
+	std::mutex cache_mutex;
+	std::map< Key, std::shared_future< std::shared_ptr< Sound::Sample const > > > cache;
+
+	//is the entry's load done (and successful)?
+	bool loaded(std::shared_future< std::shared_ptr< Sound::Sample const > > const &entry) {
+		return entry.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+}
+
+std::shared_ptr< Sound::Sample const > Sound::get_sample(std::string const &filename, Sample::LoadMode mode, Sample::Encoding encoding) {
+	Key key{filename, mode, encoding};
+
+	std::promise< std::shared_ptr< Sample const > > promise;
+	std::shared_future< std::shared_ptr< Sample const > > entry;
+	{ //find the entry, or make one (which this call is then responsible for loading):
+		std::unique_lock< std::mutex > lock(cache_mutex);
+		auto f = cache.find(key);
+		if (f != cache.end()) {
+			entry = f->second;
+			lock.unlock();
+			return entry.get(); //(waits if another thread is loading it)
+		}
+		entry = promise.get_future().share();
+		cache.emplace(key, entry);
+	}
+
+	//load without holding the lock, so other samples can load at the same time:
+	try {
+		std::shared_ptr< Sample const > sample = std::make_shared< Sample >(filename, mode, encoding);
+		promise.set_value(sample);
+		return sample;
+	} catch (...) {
+		{ //don't cache the failure:
+			std::unique_lock< std::mutex > lock(cache_mutex);
+			cache.erase(key);
+		}
+		promise.set_exception(std::current_exception());
+		throw;
+	}
+}
+
+uint32_t Sound::evict_sample(std::string const &filename) {
+	std::unique_lock< std::mutex > lock(cache_mutex);
+	uint32_t evicted = 0;
+	for (auto i = cache.lower_bound(Key{filename, Sample::LoadMode(0), Sample::Encoding(0)}); i != cache.end() && i->first.filename == filename; /* later */) {
+		//(entries still loading are left alone; their loaders will return them)
+		// (as are samples still playing -- voices refer to them directly)
+		if (loaded(i->second) && !i->second.get()->playing()) {
+			i = cache.erase(i);
+			++evicted;
+		} else {
+			++i;
+		}
+	}
+	return evicted;
+}
+
+uint32_t Sound::evict_unused_samples() {
+	std::unique_lock< std::mutex > lock(cache_mutex);
+	uint32_t evicted = 0;
+	for (auto i = cache.begin(); i != cache.end(); /* later */) {
+		if (loaded(i->second) && i->second.get().use_count() == 1 && !i->second.get()->playing()) {
+			i = cache.erase(i);
+			++evicted;
+		} else {
+			++i;
+		}
+	}
+	return evicted;
+}
+
+Sound::SampleCacheStats Sound::sample_cache_stats() {
+	std::unique_lock< std::mutex > lock(cache_mutex);
+	SampleCacheStats stats;
+	for (auto const &[key, entry] : cache) {
+		if (!loaded(entry)) continue;
+		std::shared_ptr< Sample const > const &sample = entry.get();
+		stats.samples += 1;
+		if (sample.use_count() > 1) stats.in_use += 1;
+		stats.bytes += sample->data.size() * sizeof(float)
+		             + sample->data_i16.size() * sizeof(int16_t)
+		             + sample->data_adpcm.size();
+	}
+	return stats;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+ * A process-wide cache of loaded Sound::Samples, so that modes (or Load<>s) that
+ * use the same audio file share one decoded copy:
+ *
+ * //in any mode:
+ * std::shared_ptr< Sound::Sample const > zombie = Sound::get_sample(data_path("zombie_1.opus"));
+ * Sound::play(*zombie);
+ *
+ * Samples are keyed by file path (exactly as given -- use data_path() consistently),
+ * load mode, and encoding; the first request loads the sample, later requests share it.
+ * Concurrent requests for the same sample (e.g., from Load<> worker threads) wait for one load.
+ *
+ * The cache keeps its own reference to every sample until evicted.
+ * Playing voices refer to samples directly (and don't hold references), so eviction skips samples
+ *  that are still playing (see Sample::playing()); evict them again once they have stopped.
+ * NOTE: the same goes for references held outside the cache -- only drop the last one once the sample has stopped.
+ *
+ */
+
+#include "Sound.hpp"
+
+#include <memory>
+#include <string>
+
+namespace Sound {
+
+//get a shared sample, loading it if it isn't in the cache:
+// (throws if loading fails; a failed load is not cached, so a later request will try again)
+std::shared_ptr< Sample const > get_sample(std::string const &filename,
+	Sample::LoadMode mode = Sample::Decoded,
+	Sample::Encoding encoding = Sample::Float32
+);
+
+//remove the cache's references to every version (mode/encoding) of a file that isn't playing:
+// returns the number of entries removed
+uint32_t evict_sample(std::string const &filename);
+
+//remove cache entries that nothing outside the cache refers to (and that aren't playing):
+// returns the number of entries removed
+uint32_t evict_unused_samples();
+
+//current cache contents:
+struct SampleCacheStats {
+	uint32_t samples = 0; //cached samples
+	uint32_t in_use = 0; //...that something outside the cache also refers to
+	size_t bytes = 0; //memory used by (non-streamed) sample data
+};
+SampleCacheStats sample_cache_stats();
+
+} //namespace Sound
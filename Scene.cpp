@@ -2,11 +2,14 @@
 
 #include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
+#include "simd.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <cmath>
 
 //-------------------------
@@ -58,18 +61,52 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 	);
 }
 
-glm::mat4x3 Scene::Transform::make_local_to_world() const {
-	if (!parent) {
-		return make_local_to_parent();
-	} else {
-		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+void Scene::Transform::update_cache(uint32_t pass) const {
+	if (pass != 0 && cache.pass == pass) return; //already checked this pass
+
+	if (parent) parent->update_cache(pass);
+
+	if (position != cache.position || rotation != cache.rotation || scale != cache.scale
+	 || parent != cache.parent || (parent && parent->cache.version != cache.parent_version)) {
+		cache.position = position;
+		cache.rotation = rotation;
+		cache.scale = scale;
+		cache.parent = parent;
+		if (!parent) {
+			cache.local_to_world = make_local_to_parent();
+		} else {
+			cache.parent_version = parent->cache.version;
+			cache.local_to_world = parent->cache.local_to_world * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		cache.world_to_local_valid = false;
+		cache.version += 1;
 	}
+
+	cache.pass = pass;
+}
+
+glm::mat4x3 Scene::Transform::make_local_to_world() const {
+	update_cache();
+	return cache.local_to_world;
 }
 glm::mat4x3 Scene::Transform::make_world_to_local() const {
-	if (!parent) {
-		return make_parent_to_local();
-	} else {
-		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+	update_cache();
+	if (!cache.world_to_local_valid) {
+		if (!parent) {
+			cache.world_to_local = make_parent_to_local();
+		} else {
+			cache.world_to_local = make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		cache.world_to_local_valid = true;
+	}
+	return cache.world_to_local;
+}
+
+void Scene::update_transforms() const {
+	transform_pass += 1;
+	if (transform_pass == 0) transform_pass = 1; //(0 means "no pass")
+	for (auto const &transform : transforms) {
+		transform.update_cache(transform_pass);
 	}
 }
 
@@ -95,53 +132,248 @@ void Scene::draw(Camera const &camera) const {
 	draw(world_to_clip, world_to_light);
 }
 
-void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+namespace {
+	//Per-drawable matrices, laid out the way the INSTANCE_* attributes read them:
+	struct InstanceData {
+		float OBJECT_TO_CLIP[16];
+		float OBJECT_TO_LIGHT[12];
+		float NORMAL_TO_LIGHT[9];
+	};
+	static_assert(sizeof(InstanceData) == 4*16 + 4*12 + 4*9, "InstanceData is packed.");
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
-		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+	void compute_matrices(Scene::Drawable const &drawable, uint32_t pass, glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light, InstanceData *out) {
+		//the object-to-world matrix is used in all three of these:
+		assert(drawable.transform); //drawables *must* have a transform
+		//(the update pass at the start of draw() has usually done this already)
+		drawable.transform->update_cache(pass);
+		glm::mat4x3 const &object_to_world = drawable.transform->cache.local_to_world;
 
-		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
-		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
-		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
+		//OBJECT_TO_CLIP takes vertices from object space to clip space:
+		glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
+		std::memcpy(out->OBJECT_TO_CLIP, glm::value_ptr(object_to_clip), sizeof(out->OBJECT_TO_CLIP));
 
+		//OBJECT_TO_LIGHT takes vertices from object space to light space:
+		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+		std::memcpy(out->OBJECT_TO_LIGHT, glm::value_ptr(object_to_light), sizeof(out->OBJECT_TO_LIGHT));
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+		//NORMAL_TO_LIGHT takes normals from object space to light space:
+		glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
+		std::memcpy(out->NORMAL_TO_LIGHT, glm::value_ptr(normal_to_light), sizeof(out->NORMAL_TO_LIGHT));
+	}
 
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+	//upload matrices as uniforms:
+	void set_matrix_uniforms(Scene::Drawable::Pipeline const &pipeline, InstanceData const &matrices, Scene::DrawStats *stats) {
+		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
+			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, matrices.OBJECT_TO_CLIP);
+			stats->uniform_uploads += 1;
+		}
+		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
+			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, matrices.OBJECT_TO_LIGHT);
+			stats->uniform_uploads += 1;
+		}
+		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
+			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, matrices.NORMAL_TO_LIGHT);
+			stats->uniform_uploads += 1;
+		}
+	}
 
-		//Configure program uniforms:
+	bool can_instance(Scene::Drawable::Pipeline const &pipeline) {
+		return pipeline.INSTANCED_bool != -1U && !pipeline.set_uniforms;
+	}
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+	//order for batching: by program, then vao, then textures, then mesh:
+	bool batch_less(Scene::Drawable const *a_, Scene::Drawable const *b_) {
+		Scene::Drawable::Pipeline const &a = a_->pipeline;
+		Scene::Drawable::Pipeline const &b = b_->pipeline;
+		if (a.program != b.program) return a.program < b.program;
+		if (a.vao != b.vao) return a.vao < b.vao;
+		for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+			if (a.textures[i].texture != b.textures[i].texture) return a.textures[i].texture < b.textures[i].texture;
+			if (a.textures[i].target != b.textures[i].target) return a.textures[i].target < b.textures[i].target;
+		}
+		if (a.type != b.type) return a.type < b.type;
+		if (a.start != b.start) return a.start < b.start;
+		return a.count < b.count;
+	}
 
-		//OBJECT_TO_CLIP takes vertices from object space to clip space:
-		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+	//can a and b be drawn in one instanced call?
+	bool same_batch(Scene::Drawable::Pipeline const &a, Scene::Drawable::Pipeline const &b) {
+		if (!can_instance(a) || !can_instance(b)) return false;
+		if (a.program != b.program || a.vao != b.vao) return false;
+		for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+			if (a.textures[i].texture != b.textures[i].texture || a.textures[i].target != b.textures[i].target) return false;
 		}
+		return a.type == b.type && a.start == b.start && a.count == b.count;
+	}
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+	//Frustum culling:
+	// keeps drawables whose bounding box (transformed to a world-space box) touches all six frustum planes.
+	// Boxes are tested four at a time, from structure-of-arrays scratch space.
 
-		//OBJECT_TO_CLIP takes vertices from object space to light space:
-		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+	//world-space box centers and half-extents, padded to a multiple of four:
+	struct CullBoxes {
+		std::vector< float > cx, cy, cz, ex, ey, ez;
+		std::vector< uint32_t > boxed; //index in 'drawables' of each box
+		uint32_t count = 0; //boxes, not counting padding
+	};
+
+	//kernels set outside[boxes.boxed[b]] for each box b that is entirely behind any plane, i.e., dot(n, c) + w + dot(|n|, e) < 0:
+	typedef void (*CullBoxesFn)(CullBoxes const &boxes, glm::vec4 const *planes, uint8_t *outside);
+
+	void cull_boxes_scalar(CullBoxes const &boxes, glm::vec4 const *planes, uint8_t *outside) {
+		for (uint32_t b = 0; b < boxes.count; ++b) {
+			for (uint32_t p = 0; p < 6; ++p) {
+				glm::vec4 const &plane = planes[p];
+				float dist = boxes.cx[b] * plane.x + boxes.cy[b] * plane.y + boxes.cz[b] * plane.z + plane.w;
+				float reach = boxes.ex[b] * std::abs(plane.x) + boxes.ey[b] * std::abs(plane.y) + boxes.ez[b] * std::abs(plane.z);
+				if (dist + reach < 0.0f) outside[boxes.boxed[b]] = 1;
+			}
 		}
+	}
 
-		//NORMAL_TO_CLIP takes normals from object space to light space:
-		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+#ifdef SIMD_X86
+	SIMD_TARGET("sse2")
+	void cull_boxes_sse2(CullBoxes const &boxes, glm::vec4 const *planes, uint8_t *outside) {
+		for (uint32_t b = 0; b < boxes.count; b += 4) {
+			__m128 out = _mm_setzero_ps();
+			__m128 c_x = _mm_loadu_ps(&boxes.cx[b]), c_y = _mm_loadu_ps(&boxes.cy[b]), c_z = _mm_loadu_ps(&boxes.cz[b]);
+			__m128 e_x = _mm_loadu_ps(&boxes.ex[b]), e_y = _mm_loadu_ps(&boxes.ey[b]), e_z = _mm_loadu_ps(&boxes.ez[b]);
+			for (uint32_t p = 0; p < 6; ++p) {
+				glm::vec4 const &plane = planes[p];
+				__m128 dist = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(c_x, _mm_set1_ps(plane.x)), _mm_mul_ps(c_y, _mm_set1_ps(plane.y))),
+					_mm_add_ps(_mm_mul_ps(c_z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w))
+				);
+				__m128 reach = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(e_x, _mm_set1_ps(std::abs(plane.x))), _mm_mul_ps(e_y, _mm_set1_ps(std::abs(plane.y)))),
+					_mm_mul_ps(e_z, _mm_set1_ps(std::abs(plane.z)))
+				);
+				out = _mm_or_ps(out, _mm_cmplt_ps(_mm_add_ps(dist, reach), _mm_setzero_ps()));
+			}
+			int mask = _mm_movemask_ps(out);
+			for (uint32_t i = 0; i < 4 && b + i < boxes.count; ++i) {
+				outside[boxes.boxed[b + i]] = (mask >> i) & 1;
+			}
+		}
+	}
+
+	CullBoxesFn const cull_boxes = simd_select(cull_boxes_scalar, cull_boxes_sse2, cull_boxes_sse2);
+#else
+	CullBoxesFn const cull_boxes = cull_boxes_scalar;
+#endif
+
+	void cull_to_frustum(std::vector< Scene::Drawable const * > *drawables_, glm::mat4 const &world_to_clip, uint32_t pass, Scene::DrawStats *stats) {
+		std::vector< Scene::Drawable const * > &drawables = *drawables_;
+
+		//planes from the rows of world_to_clip; a point p is inside when dot(plane, (p,1)) >= 0 for all six:
+		// (with an infinite projection the far plane comes out as (0,0,0,w>0), which never culls)
+		glm::vec4 planes[6];
+		for (uint32_t i = 0; i < 3; ++i) {
+			glm::vec4 row_i = glm::vec4(world_to_clip[0][i], world_to_clip[1][i], world_to_clip[2][i], world_to_clip[3][i]);
+			glm::vec4 row_w = glm::vec4(world_to_clip[0][3], world_to_clip[1][3], world_to_clip[2][3], world_to_clip[3][3]);
+			planes[2*i+0] = row_w + row_i;
+			planes[2*i+1] = row_w - row_i;
+		}
+
+		//(drawables without a box -- min > max -- are always kept, and are not put in 'boxes')
+		static CullBoxes boxes;
+		static std::vector< uint8_t > outside;
+		std::vector< float > &cx = boxes.cx, &cy = boxes.cy, &cz = boxes.cz, &ex = boxes.ex, &ey = boxes.ey, &ez = boxes.ez;
+		cx.clear(); cy.clear(); cz.clear(); ex.clear(); ey.clear(); ez.clear();
+		boxes.boxed.clear();
+		outside.assign(drawables.size(), 0);
+
+		for (uint32_t d = 0; d < drawables.size(); ++d) {
+			Scene::Drawable const &drawable = *drawables[d];
+			if (!(drawable.min.x <= drawable.max.x && drawable.min.y <= drawable.max.y && drawable.min.z <= drawable.max.z)) continue;
+
+			drawable.transform->update_cache(pass);
+			glm::mat4x3 const &object_to_world = drawable.transform->cache.local_to_world;
+
+			glm::vec3 center = 0.5f * (drawable.max + drawable.min);
+			glm::vec3 radius = 0.5f * (drawable.max - drawable.min);
+			glm::vec3 world_center = object_to_world * glm::vec4(center, 1.0f);
+			//extent of the transformed box along each world axis:
+			glm::vec3 world_radius =
+				  glm::abs(object_to_world[0]) * radius.x
+				+ glm::abs(object_to_world[1]) * radius.y
+				+ glm::abs(object_to_world[2]) * radius.z;
+
+			cx.emplace_back(world_center.x); cy.emplace_back(world_center.y); cz.emplace_back(world_center.z);
+			ex.emplace_back(world_radius.x); ey.emplace_back(world_radius.y); ez.emplace_back(world_radius.z);
+			boxes.boxed.emplace_back(d);
+		}
+		boxes.count = uint32_t(boxes.boxed.size());
+		while (cx.size() % 4 != 0) {
+			//padding boxes are never read back, so any values will do:
+			cx.emplace_back(0.0f); cy.emplace_back(0.0f); cz.emplace_back(0.0f);
+			ex.emplace_back(0.0f); ey.emplace_back(0.0f); ez.emplace_back(0.0f);
 		}
 
+		cull_boxes(boxes, planes, outside.data());
+
+		//compact, preserving order:
+		uint32_t kept = 0;
+		for (uint32_t d = 0; d < drawables.size(); ++d) {
+			if (!outside[d]) drawables[kept++] = drawables[d];
+		}
+		stats->culled += uint32_t(drawables.size()) - kept;
+		drawables.resize(kept);
+	}
+
+	//skip any drawables that can't be drawn:
+	bool is_drawable(Scene::Drawable::Pipeline const &pipeline) {
+		//skip any drawables without a shader program set:
+		if (pipeline.program == 0) return false;
+		//skip any drawables that don't reference any vertex array:
+		if (pipeline.vao == 0) return false;
+		//skip any drawables that don't contain any vertices:
+		if (pipeline.count == 0) return false;
+		return true;
+	}
+}
+
+void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	//scratch space, kept between frames to avoid re-allocating:
+	// (drawing only ever happens on the thread with the OpenGL context)
+	static std::vector< Drawable const * > visible;
+
+	draw_stats = DrawStats();
+
+	update_transforms();
+
+	//gather drawables that can be drawn and are (possibly) on screen:
+	visible.clear();
+	for (auto const &drawable : drawables) {
+		if (is_drawable(drawable.pipeline)) visible.emplace_back(&drawable);
+	}
+	if (frustum_culling) cull_to_frustum(&visible, world_to_clip, transform_pass, &draw_stats);
+	draw_stats.visible = uint32_t(visible.size());
+
+	if (draw_mode == DrawMode::Batched) {
+		draw_batched(visible, world_to_clip, world_to_light);
+		return;
+	}
+
+	//Iterate through all visible drawables, sending each one to OpenGL:
+	for (Drawable const *drawable_ptr : visible) {
+		Drawable const &drawable = *drawable_ptr;
+		//Reference to drawable's pipeline for convenience:
+		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+
+		//Set shader program:
+		glUseProgram(pipeline.program);
+		draw_stats.program_changes += 1;
+
+		//Set attribute sources:
+		glBindVertexArray(pipeline.vao);
+		draw_stats.vao_changes += 1;
+
+		//Configure program uniforms:
+		InstanceData matrices;
+		compute_matrices(drawable, transform_pass, world_to_clip, world_to_light, &matrices);
+		set_matrix_uniforms(pipeline, matrices, &draw_stats);
+
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
@@ -150,17 +382,21 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 			if (pipeline.textures[i].texture != 0) {
 				glActiveTexture(GL_TEXTURE0 + i);
 				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+				draw_stats.texture_changes += 1;
 			}
 		}
 
 		//draw the object:
 		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		draw_stats.draw_calls += 1;
+		draw_stats.drawables += 1;
 
 		//un-bind textures:
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
 			if (pipeline.textures[i].texture != 0) {
 				glActiveTexture(GL_TEXTURE0 + i);
 				glBindTexture(pipeline.textures[i].target, 0);
+				draw_stats.texture_changes += 1;
 			}
 		}
 		glActiveTexture(GL_TEXTURE0);
@@ -173,14 +409,144 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 	GL_ERRORS();
 }
 
+void Scene::draw_batched(std::vector< Drawable const * > &order, glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	//scratch space, kept between frames to avoid re-allocating:
+	// (drawing only ever happens on the thread with the OpenGL context)
+	static std::vector< InstanceData > instances;
+	//per-instance matrices are streamed through this buffer:
+	static GLuint instance_buffer = 0;
+	static size_t instance_buffer_size = 0; //only grows, so attribute offsets left in vaos stay in range
+
+	//sort drawables so that ones with the same state are adjacent:
+	std::sort(order.begin(), order.end(), batch_less);
+
+	//compute all the matrices up front, so instance data can be uploaded in one go:
+	instances.resize(order.size());
+	for (size_t i = 0; i < order.size(); ++i) {
+		compute_matrices(*order[i], transform_pass, world_to_clip, world_to_light, &instances[i]);
+	}
+
+	if (!instances.empty()) {
+		if (instance_buffer == 0) glGenBuffers(1, &instance_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+		size_t bytes = instances.size() * sizeof(InstanceData);
+		if (bytes > instance_buffer_size) instance_buffer_size = std::max(bytes, 2 * instance_buffer_size);
+		glBufferData(GL_ARRAY_BUFFER, instance_buffer_size, nullptr, GL_STREAM_DRAW); //(orphan last frame's data)
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+	}
+
+	//current state, to skip redundant changes:
+	GLuint current_program = 0;
+	GLuint current_INSTANCED = -1U; //INSTANCED_bool location in current program, if it was set to true
+	GLuint current_vao = 0;
+	Drawable::Pipeline::TextureInfo current_textures[Drawable::Pipeline::TextureCount];
+
+	//programs are left with INSTANCED off:
+	auto instancing_off = [&]() {
+		if (current_INSTANCED != -1U) {
+			glUniform1i(current_INSTANCED, GL_FALSE);
+			current_INSTANCED = -1U;
+		}
+	};
+
+	//point a per-instance matrix attribute at the instance data starting at 'first':
+	auto set_instance_attribute = [&](GLuint location, uint32_t columns, GLint rows, size_t first, size_t offset) {
+		if (location == -1U) return;
+		for (uint32_t c = 0; c < columns; ++c) {
+			glEnableVertexAttribArray(location + c);
+			glVertexAttribPointer(location + c, rows, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+				(GLbyte *)0 + first * sizeof(InstanceData) + offset + c * rows * sizeof(float));
+			glVertexAttribDivisor(location + c, 1);
+		}
+	};
+
+	for (size_t begin = 0; begin < order.size(); /* later */) {
+		Drawable::Pipeline const &pipeline = order[begin]->pipeline;
+
+		//find the run of drawables that can be instanced with this one:
+		size_t end = begin + 1;
+		bool instanced = can_instance(pipeline);
+		if (instanced) {
+			while (end < order.size() && same_batch(pipeline, order[end]->pipeline)) ++end;
+		}
+
+		if (pipeline.program != current_program) {
+			instancing_off();
+			glUseProgram(pipeline.program);
+			current_program = pipeline.program;
+			draw_stats.program_changes += 1;
+		}
+		if (!instanced) {
+			instancing_off();
+		} else if (current_INSTANCED == -1U) {
+			glUniform1i(pipeline.INSTANCED_bool, GL_TRUE);
+			current_INSTANCED = pipeline.INSTANCED_bool;
+		}
+
+		if (pipeline.vao != current_vao) {
+			glBindVertexArray(pipeline.vao);
+			current_vao = pipeline.vao;
+			draw_stats.vao_changes += 1;
+		}
+
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			Drawable::Pipeline::TextureInfo const &want = pipeline.textures[i];
+			Drawable::Pipeline::TextureInfo &have = current_textures[i];
+			if (want.texture == have.texture && (want.texture == 0 || want.target == have.target)) continue;
+			glActiveTexture(GL_TEXTURE0 + i);
+			if (have.texture != 0 && (want.texture == 0 || want.target != have.target)) {
+				glBindTexture(have.target, 0);
+				draw_stats.texture_changes += 1;
+			}
+			if (want.texture != 0) {
+				glBindTexture(want.target, want.texture);
+				draw_stats.texture_changes += 1;
+			}
+			have = want;
+		}
+
+		if (instanced) {
+			//(GL_ARRAY_BUFFER is still bound to instance_buffer)
+			set_instance_attribute(pipeline.INSTANCE_OBJECT_TO_CLIP_mat4, 4, 4, begin, offsetof(InstanceData, OBJECT_TO_CLIP));
+			set_instance_attribute(pipeline.INSTANCE_OBJECT_TO_LIGHT_mat4x3, 4, 3, begin, offsetof(InstanceData, OBJECT_TO_LIGHT));
+			set_instance_attribute(pipeline.INSTANCE_NORMAL_TO_LIGHT_mat3, 3, 3, begin, offsetof(InstanceData, NORMAL_TO_LIGHT));
+			glDrawArraysInstanced(pipeline.type, pipeline.start, pipeline.count, GLsizei(end - begin));
+		} else {
+			set_matrix_uniforms(pipeline, instances[begin], &draw_stats);
+			if (pipeline.set_uniforms) pipeline.set_uniforms();
+			glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		}
+		draw_stats.draw_calls += 1;
+		draw_stats.drawables += uint32_t(end - begin);
+
+		begin = end;
+	}
+
+	//leave things as the simple path does:
+	instancing_off();
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (current_textures[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(current_textures[i].target, 0);
+			draw_stats.texture_changes += 1;
+		}
+	}
+	glActiveTexture(GL_TEXTURE0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glUseProgram(0);
+	glBindVertexArray(0);
+
+	GL_ERRORS();
+}
+
 
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 
-	std::ifstream file(filename, std::ios::binary);
+	ChunkFile file(filename);
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	ChunkSpan< char > names = file.read< char >("str0");
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -191,8 +557,7 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	ChunkSpan< HierarchyEntry > hierarchy = file.read< HierarchyEntry >("xfh0");
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -200,8 +565,7 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	ChunkSpan< MeshEntry > meshes = file.read< MeshEntry >("msh0");
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -210,8 +574,7 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > cameras;
-	read_chunk(file, "cam0", &cameras);
+	ChunkSpan< CameraEntry > cameras = file.read< CameraEntry >("cam0");
 
 	struct LightEntry {
 		uint32_t transform;
@@ -222,8 +585,7 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > lights;
-	read_chunk(file, "lmp0", &lights);
+	ChunkSpan< LightEntry > lights = file.read< LightEntry >("lmp0");
 
 
 	//--------------------------------
@@ -310,9 +672,12 @@ void Scene::load(std::string const &filename,
 	}
 
 	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	// (from a stream over the rest of the mapped file)
+	ChunkStreamBuf rest_buf(file.remaining());
+	std::istream rest(&rest_buf);
+	load_extra(rest, std::vector< char >(names.begin(), names.end()), hierarchy_transforms);
 
-	if (file.peek() != EOF) {
+	if (rest.peek() != EOF) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
@@ -345,6 +710,9 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 	//null transform maps to itself:
 	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
 
+	draw_mode = other.draw_mode;
+	frustum_culling = other.frustum_culling;
+
 	//Copy transforms and store mapping:
 	transforms.clear();
 	for (auto const &t : other.transforms) {
@@ -15,6 +15,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <limits>
 #include <list>
 #include <memory>
 #include <functional>
@@ -40,9 +41,33 @@ struct Scene {
 		glm::mat4x3 make_local_to_parent() const;
 		glm::mat4x3 make_parent_to_local() const;
 		// ..relative to the world:
+		// (these come from 'cache', and are only recomputed when this transform or an ancestor has changed)
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
 
+		//Cached world matrices:
+		// position/rotation/scale/parent are plain members, so rather than needing "set" functions to flag changes,
+		// the cache remembers the values it was computed from and compares against them.
+		struct Cache {
+			glm::vec3 position = glm::vec3(std::numeric_limits< float >::quiet_NaN()); //(NaN never matches, so first use computes)
+			glm::quat rotation;
+			glm::vec3 scale;
+			Transform const *parent = nullptr;
+			uint32_t parent_version = 0; //parent's 'version' when local_to_world was computed
+
+			uint32_t version = 0; //incremented whenever local_to_world changes (so children know to recompute)
+			uint32_t pass = 0; //last update pass that checked this transform (see Scene::update_transforms)
+
+			glm::mat4x3 local_to_world;
+			glm::mat4x3 world_to_local;
+			bool world_to_local_valid = false; //(computed on demand, since most transforms never need it)
+		};
+		mutable Cache cache;
+
+		//bring 'cache.local_to_world' up to date (after bringing ancestors up to date):
+		// 'pass' != 0 skips transforms already checked during the same pass.
+		void update_cache(uint32_t pass = 0) const;
+
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
 		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
@@ -54,6 +79,11 @@ struct Scene {
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//object-space bounding box, used for frustum culling:
+		// (the default, an empty box, means "bounds unknown" and is never culled)
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
@@ -78,6 +108,15 @@ struct Scene {
 				GLuint texture = 0;
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
+
+			//instancing (optional; see LitColorTextureProgram for an example):
+			// if the program reads the three matrices above from per-instance attributes when its INSTANCED uniform is set,
+			// batched drawing can draw all the drawables that share a mesh with one glDrawArraysInstanced call.
+			// (drawables with 'set_uniforms' are never instanced)
+			GLuint INSTANCED_bool = -1U; //uniform location of instancing switch
+			GLuint INSTANCE_OBJECT_TO_CLIP_mat4 = -1U; //attribute locations of per-instance matrices
+			GLuint INSTANCE_OBJECT_TO_LIGHT_mat4x3 = -1U;
+			GLuint INSTANCE_NORMAL_TO_LIGHT_mat3 = -1U;
 		} pipeline;
 	};
 
@@ -131,12 +170,42 @@ struct Scene {
 	std::list< Camera > cameras;
 	std::list< Light > lights;
 
+	//Refresh the cached world matrices of all transforms in one pass:
+	// (parents are checked before children; unchanged transforms cost only a comparison)
+	void update_transforms() const;
+	mutable uint32_t transform_pass = 0; //current pass number for update_cache()
+
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//How draw() sends drawables to OpenGL:
+	enum class DrawMode {
+		Simple, //each drawable in list order, setting all of its state
+		Batched, //sorted by state, skipping redundant state changes and instancing drawables that share a mesh (draw order not preserved)
+	} draw_mode = DrawMode::Batched;
+
+	//skip drawables whose bounding box is entirely outside the view frustum?
+	bool frustum_culling = true;
+
+	//Counters from the most recent draw():
+	struct DrawStats {
+		uint32_t culled = 0; //drawables skipped by frustum culling
+		uint32_t visible = 0; //drawables that passed culling
+		uint32_t drawables = 0; //drawables drawn
+		uint32_t draw_calls = 0; //glDrawArrays* calls
+		uint32_t program_changes = 0; //glUseProgram calls
+		uint32_t vao_changes = 0; //glBindVertexArray calls
+		uint32_t texture_changes = 0; //glBindTexture calls
+		uint32_t uniform_uploads = 0; //per-drawable matrix glUniform* calls
+	};
+	mutable DrawStats draw_stats;
+
+	//(used by draw() in DrawMode::Batched; sorts 'visible' in place)
+	void draw_batched(std::vector< Drawable const * > &visible, glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const;
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
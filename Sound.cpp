@@ -1,27 +1,245 @@
 #include "Sound.hpp"
+#include "RingBuffer.hpp"
+#include "OpusStream.hpp"
+#include "mix_kernel.hpp"
+#include "adpcm.hpp"
+#include "convolve.hpp"
+#include "spatialize.hpp"
+#include "limiter.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
 
 #include <SDL.h>
 
-#include <list>
+#include <atomic>
+#include <chrono>
 #include <cassert>
 #include <exception>
+#include <stdexcept>
 #include <iostream>
 #include <algorithm>
+#include <cmath>
 
 //local (to this file) data used by the audio system:
 namespace {
 
 	//handy constants:
-	constexpr uint32_t const AUDIO_RATE = 48000; //sampling rate
-	constexpr uint32_t const MIX_SAMPLES = 1024; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	constexpr uint32_t const AUDIO_RATE = Sound::AUDIO_RATE; //sampling rate
+	constexpr uint32_t const MaxMixSamples = Sound::MAX_MIX_SAMPLES; //largest block size (sizes scratch buffers)
+
+	//number of samples to mix per call of mix_audio callback, and how long that is (in seconds; ramps step by this):
+	// (only changed while no audio device is open -- see Sound::set_block_size())
+	uint32_t block_size = Sound::MIX_SAMPLES;
+	float ramp_step = float(Sound::MIX_SAMPLES) / float(AUDIO_RATE);
+	constexpr float const MaxRate = 4.0f; //fastest playback rate (limits the sample data one block can read)
 
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	//Sound::render() output that didn't fit in the requested frames, kept for the next call:
+	std::vector< float > render_block;
+	uint32_t render_offset = 0; //next frame of render_block to hand out
+
+	//Reverb (audio thread only; swapped in by 'SetReverb' commands):
+	Convolver *reverb = nullptr;
+	float reverb_input[2 * MaxMixSamples]; //voices' sends, mixed each block
+	std::vector< float > reverb_ir; //(game thread) impulse response of the current reverb, for rebuilding it if the block size changes
+
+	//reverbs replaced by the audio thread, waiting to be freed by the game thread:
+	RingBuffer< Convolver *, 64 > retired_reverbs;
+
+	//A bus holds a mixer group's state and mix buffer:
+	// (made by the game thread, then handed to the audio thread with an 'AddGroup' command)
+	struct Bus {
+		uint32_t parent = 0; //group this one mixes into
+
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+		bool paused = false;
+		Sound::Ramp< float > fade = Sound::Ramp< float >(1.0f); //pause fade (0 == fully paused)
+
+		//peak limiter: (off if threshold is infinite)
+		float threshold = std::numeric_limits< float >::infinity();
+		float release = 0.0f; //per-frame recovery coefficient
+		float limiter_gain = 1.0f; //gain reduction at the end of the last block
+
+		std::vector< float > buffer; //mix for this block (room for 2 * MaxMixSamples, interleaved; unused for master, which mixes straight to the output)
+
+		//computed at the start of each block:
+		float *out = nullptr; //where the group's voices (and subgroups) mix
+		bool mixed = false; //did anything mix into 'out' this block?
+		bool frozen = false; //paused (this group or a parent), so voices don't advance
+		float start_gain = 1.0f, end_gain = 1.0f; //this group's gain (volume * fade) over the block
+		float start_total = 1.0f, end_total = 1.0f; //...and the product of the gains from here up to the output
+		float start_send = 1.0f, end_send = 1.0f; //...and from here up to (not including) master, for reverb sends
+	};
+
+	constexpr uint32_t const MaxGroups = 32;
+	Bus master_bus;
+	Limiter master_limiter(MaxMixSamples); //(master's limiter looks ahead; see process_bus)
+	Bus *buses[MaxGroups] = { &master_bus }; //(audio thread; later entries filled in by 'AddGroup')
+	uint32_t bus_count = 1;
+	uint32_t groups_created = 1; //(game thread)
+
+	//Audio clock: frame at the start of the next block to mix (written by mix_audio):
+	std::atomic< uint64_t > audio_frames{0};
+
+	//Mixing time measurements (written by mix_audio, read by Sound::timing()):
+	std::atomic< float > timing_average_ms{0.0f};
+	std::atomic< float > timing_max_ms{0.0f};
+	std::atomic< uint32_t > timing_overruns{0};
+	std::atomic< uint32_t > timing_late{0};
+	std::atomic< uint32_t > timing_histogram[Sound::Timing::Buckets] = {};
+	std::chrono::steady_clock::time_point last_callback; //(audio thread)
+	uint32_t blocks_since_open = 0; //(the first few blocks after opening the device are warm-up, so don't count as overruns)
+	constexpr uint32_t const WarmupBlocks = 16;
+
+	//Mixer statistics (written by mix_audio, read by Sound::timing()):
+	std::atomic< uint32_t > stats_voices_mixed{0};
+	std::atomic< uint32_t > stats_voices_virtual{0};
+	std::atomic< uint32_t > stats_voices_held{0};
+	std::atomic< uint32_t > stats_voices_stopped{0};
+	std::atomic< float > stats_peak{0.0f};
+	std::atomic< uint32_t > stats_clipped{0};
+
+	//Adaptive block size (game thread):
+	constexpr uint32_t const AdaptiveOverruns = 3; //grow the block size after this many overruns...
+	constexpr std::chrono::seconds const AdaptiveWindow(10); //...within this long
+	uint32_t overruns_at_window_start = 0;
+	std::chrono::steady_clock::time_point window_start;
+
+	//A voice holds the playback state of one playing sample:
+	// (only touched by the audio callback, or with the audio device locked)
+	struct Voice {
+		Sound::Sample const *sample = nullptr; //sample being played
+		uint32_t i = 0; //next data value to read
+		float frac = 0.0f; //playback position past 'i', in [0,1) (nonzero only after playing at rates other than 1)
+		uint32_t stream_serial = 0; //playback serial, if sample is streamed
+		AdpcmCursor adpcm; //decoder state, if sample is ADPCM-encoded
+		bool loop = false; //should playback loop after data runs out?
+		bool stopping = false; //is playing stopping?
+		uint32_t group = 0; //mixer group
+		uint64_t start_at = 0; //audio frame to start playing at
+		uint64_t stop_at = -1ULL; //audio frame to stop playing at
+
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+
+		//2D playback panning control: ('NaN' if sound played in 3D mode)
+		Sound::Ramp< float > pan = Sound::Ramp< float >(std::numeric_limits< float >::quiet_NaN());
+
+		//3D playback panning control: ('NaN' if sound played in 2D mode)
+		Sound::Ramp< glm::vec3 > position = Sound::Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
+		Sound::Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
+		uint32_t spatial = 0; //index in 'spatial' this block
+
+		//playback rate control:
+		Sound::Ramp< float > rate = Sound::Ramp< float >(1.0f);
+		bool doppler = false; //scale rate by Doppler shift? (3D mode only)
+		float block_rate = 1.0f; //actual rate (after Doppler and clamping) at the end of the last mixed block
+
+		Sound::Ramp< float > reverb_send = Sound::Ramp< float >(0.0f); //fraction of output sent to the reverb
+
+		//book-keeping for handles and voice stealing:
+		uint32_t slot = -1U; //handle slot that refers to this voice (-1U once stolen -- see apply_command)
+		uint64_t started = 0; //value of 'voices_started' when this voice started
+		float gain = 0.0f; //how loud the voice was at the end of the last block (its 'end_gain' in the mix loop: after group volumes, plus its send)
+	};
+
+	//Handles refer to voices through slots, so that voices can be swap-removed:
+	struct Slot {
+		//incremented (by the audio thread) when the voice using this slot finishes; outstanding handles then no longer match:
+		std::atomic< uint32_t > generation{0};
+		uint32_t voice = -1U; //index into 'voices' (audio thread only)
+	};
+
+	Sound::Settings settings;
+
+	//Voice pool; voices [0,voices.size()) are playing, densely packed.
+	// capacity is reserved up front so playing a sample never allocates:
+	std::vector< Voice > voices;
+	uint64_t voices_started = 0;
+
+	//A stolen voice fades out (over StealFade seconds -- in practice, the next block) rather than cutting off mid-waveform,
+	// which would click. Its handle goes stale right away, and it no longer counts against max_voices;
+	// the pool has room for StealHeadroom of these beyond max_voices:
+	constexpr float const StealFade = 1.0f / 200.0f;
+	constexpr uint32_t const StealHeadroom = 16;
+	uint32_t voices_stolen = 0; //voices fading out after being stolen
+
+	//3D panning for every voice that plays this block, computed in one batch before mixing:
+	// (capacity matches the voice pool)
+	Spatializer spatial(0);
+
+	//Slots for handles; twice as many as voices, so plays still in the command queue don't run out of handles:
+	std::unique_ptr< Slot[] > slots;
+	uint32_t slot_count = 0;
+
+	constexpr uint32_t const MaxVoices = 2048; //limits slot_count to the capacity of 'freed_slots'
+
+	//slots released by the audio thread, waiting to be handed out again by the game thread:
+	RingBuffer< uint32_t, 2 * MaxVoices > freed_slots;
+	//slots the game thread can hand out right now:
+	std::vector< uint32_t > free_slots;
+
+	//Changes requested by the game thread, applied by mix_audio at the start of each block:
+	struct Command {
+		enum Type : uint8_t {
+			Play, //start a voice playing 'sample' in 'slot' (with 'value' as volume; 'position' or 'pan' set based on 'is_3D')
+			SetVolume, //voice.volume.set(value, ramp)
+			SetPan, //voice.pan.set(value, ramp)
+			SetPosition, //voice.position.set(position, ramp)
+			SetHalfVolumeRadius, //voice.half_volume_radius.set(value, ramp)
+			SetRate, //voice.rate.set(value, ramp)
+			SetDoppler, //voice.doppler = (value != 0)
+			SetReverbSend, //voice.reverb_send.set(value, ramp)
+			Stop, //fade voice out over 'ramp'
+			StopAll, //fade all voices out
+			SetGlobalVolume, //Sound::volume.set(value, ramp)
+			SetListener, //Sound::listener.{position,right}.set({position,right}, ramp)
+			SetReverb, //swap in 'reverb' (may be null) as the reverb
+			SetReverbVolume, //Sound::reverb_volume.set(value, ramp)
+			AddGroup, //buses[group] = bus
+			SetGroupVolume, //buses[group]->volume.set(value, ramp)
+			SetGroupPaused, //pause (value != 0) or resume buses[group], fading over 'ramp'
+			SetGroupLimiter, //buses[group]->threshold = value, with release time 'ramp'
+			StopAt, //voice.stop_at = at
+		} type = Play;
+		Command() = default;
+		Command(Type type_) : type(type_) { }
+		Command(Type type_, Sound::PlayingSample const &handle) : type(type_), slot(handle.slot), generation(handle.generation) { }
+
+		//voice this command applies to:
+		uint32_t slot = -1U;
+		uint32_t generation = 0;
+
+		float value = 0.0f;
+		float ramp = 0.0f;
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::vec3 right = glm::vec3(0.0f);
+
+		//for 'Play':
+		Sound::Sample const *sample = nullptr;
+		uint32_t stream_serial = 0;
+		float pan = 0.0f;
+		float half_volume_radius = 0.0f;
+		bool is_3D = false;
+		bool loop = false;
+
+		//for 'Play' and group commands:
+		uint32_t group = 0;
+
+		//for 'Play' (start frame) and 'StopAt' (stop frame):
+		uint64_t at = 0;
+
+		//for 'SetReverb':
+		Convolver *reverb = nullptr;
+
+		//for 'AddGroup':
+		Bus *bus = nullptr;
+	};
+
+	//command queue; written by the game thread, read by the audio callback:
+	// (a few frames' worth of per-voice updates for a busy scene easily fit)
+	RingBuffer< Command, 2048 > commands;
 
 }
 
@@ -30,53 +248,114 @@ namespace {
 //global volume control:
 Sound::Ramp< float > Sound::volume = Sound::Ramp< float >(1.0f);
 
+//reverb return volume control:
+Sound::Ramp< float > Sound::reverb_volume = Sound::Ramp< float >(1.0f);
+
 //global listener information:
 Sound::Listener Sound::listener;
 
 //This audio-mixing callback is defined below:
 void mix_audio(void *, Uint8 *buffer_, int len);
 
+//Voice and command helpers are also defined below:
+void setup_voices(Sound::Settings const &settings);
+Sound::PlayingSample start(Sound::Sample const &sample, float volume, float pan, glm::vec3 const &position, float half_volume_radius, bool is_3D, bool loop, Sound::Group group, uint64_t at);
+void apply_command(Command &command);
+void enqueue(Command &&command);
+void free_retired_reverbs();
+void open_device();
+void read_samples(Sound::Sample const &sample, uint32_t begin, uint32_t count, float *out, AdpcmCursor *cursor);
+
 //------------------------ public-facing --------------------------------
 
-Sound::Sample::Sample(std::string const &filename) {
-	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
+Sound::Sample::Sample(std::string const &filename, LoadMode mode, Encoding encoding_) {
+	if (mode == Streamed) {
+		if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus")) {
+			throw std::runtime_error("Sample '" + filename + "' can't be streamed -- only \".opus\" files support streaming.");
+		}
+		stream.reset(new OpusStream(filename));
+	} else if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
 		load_wav(filename, &data);
 	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
 		load_opus(filename, &data);
 	} else {
 		throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".png\" or \".opus\" -- unsure how to load.");
 	}
+	if (!stream) encode(encoding_);
 }
 
-Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
+Sound::Sample::Sample(std::vector< float > const &data_, Encoding encoding_) : data(data_) {
+	encode(encoding_);
 }
 
+size_t Sound::Sample::size() const {
+	if (encoding == Int16) return data_i16.size();
+	if (encoding == ADPCM) return adpcm_samples;
+	return data.size();
+}
 
+void Sound::Sample::encode(Encoding encoding_) {
+	if (encoding_ == encoding) return;
+
+	//back to float first:
+	if (encoding == Int16) {
+		data.resize(data_i16.size());
+		for (size_t i = 0; i < data_i16.size(); ++i) {
+			data[i] = float(data_i16[i]) * (1.0f / 32768.0f);
+		}
+	} else if (encoding == ADPCM) {
+		data.resize(adpcm_samples);
+		AdpcmCursor cursor;
+		adpcm_decode(data_adpcm.data(), 0, adpcm_samples, data.data(), &cursor);
+	}
+	data_i16 = std::vector< int16_t >();
+	data_adpcm = std::vector< uint8_t >();
+	adpcm_samples = 0;
+
+	//...then to the new encoding:
+	if (encoding_ == Int16) {
+		data_i16.resize(data.size());
+		for (size_t i = 0; i < data.size(); ++i) {
+			data_i16[i] = int16_t(std::max(-32768.0f, std::min(32767.0f, std::round(data[i] * 32768.0f))));
+		}
+		data = std::vector< float >();
+	} else if (encoding_ == ADPCM) {
+		if (data.size() > 0xffffffffULL) throw std::runtime_error("Sample is too long to encode as ADPCM.");
+		adpcm_samples = uint32_t(data.size());
+		adpcm_encode(data.data(), adpcm_samples, &data_adpcm);
+		data = std::vector< float >();
+	}
+	encoding = encoding_;
+}
+
+Sound::Sample::Sample(Sample &&other) : encoding(other.encoding), data(std::move(other.data)), data_i16(std::move(other.data_i16)),
+	data_adpcm(std::move(other.data_adpcm)), adpcm_samples(other.adpcm_samples), stream(std::move(other.stream)) {
+	assert(!other.playing() && "moved a sample that is playing");
+}
+
+Sound::Sample::~Sample() = default;
+
+
+
+void Sound::init(Settings const &settings_) {
+	setup_voices(settings_);
+	set_block_size(settings_.block_size);
+	master.set_limiter(settings_.master_limiter);
+
+	if (settings_.backend == Settings::Backend::Null) {
+		std::cout << "Audio output disabled (null backend); mix with Sound::render()." << std::endl;
+		return;
+	}
 
-void Sound::init() {
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
 		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
 		return;
 	}
 
-	//Based on the example on https://wiki.libsdl.org/SDL_OpenAudioDevice
-	SDL_AudioSpec want, have;
-	SDL_zero(want);
-	want.freq = AUDIO_RATE;
-	want.format = AUDIO_F32SYS;
-	want.channels = 2;
-	want.samples = MIX_SAMPLES;
-	want.callback = mix_audio;
-
-	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
-	if (device == 0) {
-		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
-		std::cerr << "  (Will continue without audio.)\n" << std::endl;
-	} else {
-		//start audio playback:
-		SDL_PauseAudioDevice(device, 0);
-		std::cout << "Audio output initialized." << std::endl;
+	open_device();
+	if (device != 0) {
+		std::cout << "Audio output initialized (" << block_size << "-frame blocks)." << std::endl;
 	}
 }
 
@@ -88,8 +367,109 @@ void Sound::shutdown() {
 		SDL_CloseAudioDevice(device);
 		device = 0;
 	}
+	//(the callback has stopped, so the reverb and groups can go; with the null backend, so should any further rendering)
+	free_retired_reverbs();
+	delete reverb;
+	reverb = nullptr;
+
+	for (uint32_t g = 1; g < bus_count; ++g) {
+		delete buses[g];
+		buses[g] = nullptr;
+	}
+	bus_count = 1;
+	groups_created = 1;
+	for (auto &voice : voices) {
+		voice.group = 0;
+	}
+}
+
+
+void Sound::render(float *out, uint32_t frames) {
+	if (device != 0) {
+		throw std::runtime_error("Sound::render() can't be used while an audio device is mixing.");
+	}
+	while (frames > 0) {
+		if (2 * render_offset == render_block.size()) {
+			render_block.resize(2 * block_size); //(only allocates if the block size has changed)
+			mix_audio(nullptr, reinterpret_cast< Uint8 * >(render_block.data()), int(render_block.size() * sizeof(float)));
+			render_offset = 0;
+		}
+		uint32_t count = std::min(frames, uint32_t(render_block.size() / 2) - render_offset);
+		std::copy(render_block.data() + 2 * render_offset, render_block.data() + 2 * (render_offset + count), out);
+		out += 2 * count;
+		frames -= count;
+		render_offset += count;
+	}
+}
+
+void Sound::update() {
+	if (!settings.adaptive_block_size || device == 0 || block_size >= MaxMixSamples) return;
+
+	uint32_t overruns = timing_overruns.load(std::memory_order_relaxed);
+	auto now = std::chrono::steady_clock::now();
+	if (overruns - overruns_at_window_start >= AdaptiveOverruns) {
+		std::cout << "Audio mixing overran its " << (1000.0f * block_size / AUDIO_RATE) << " ms budget "
+		          << (overruns - overruns_at_window_start) << " times; increasing block size to " << (2 * block_size) << " frames." << std::endl;
+		set_block_size(2 * block_size);
+	} else if (now - window_start < AdaptiveWindow) {
+		return;
+	}
+	overruns_at_window_start = overruns;
+	window_start = now;
 }
 
+void Sound::set_block_size(uint32_t new_size) {
+	//round up to a power of two (as SDL requires) in range:
+	uint32_t size = Sound::MIN_MIX_SAMPLES;
+	while (size < new_size && size < MaxMixSamples) size *= 2;
+	if (size == block_size) return;
+
+	bool reopen = (device != 0);
+	if (reopen) {
+		SDL_PauseAudioDevice(device, 1);
+		SDL_CloseAudioDevice(device);
+		device = 0;
+	}
+
+	//with no callback running, apply queued commands here (so the reverb is current) before changing sizes:
+	Command pending;
+	while (commands.pop(&pending)) {
+		apply_command(pending);
+	}
+	free_retired_reverbs();
+
+	block_size = size;
+	ramp_step = float(block_size) / float(AUDIO_RATE);
+	if (reverb) {
+		delete reverb;
+		reverb = new Convolver(reverb_ir.data(), reverb_ir.size(), block_size);
+	}
+	blocks_since_open = 0;
+
+	if (reopen) {
+		open_device();
+	}
+}
+
+Sound::Timing Sound::timing() {
+	Timing timing;
+	timing.block_size = block_size;
+	timing.budget_ms = 1000.0f * block_size / AUDIO_RATE;
+	timing.average_ms = timing_average_ms.load(std::memory_order_relaxed);
+	timing.max_ms = timing_max_ms.exchange(0.0f, std::memory_order_relaxed);
+	timing.overruns = timing_overruns.load(std::memory_order_relaxed);
+	timing.late = timing_late.load(std::memory_order_relaxed);
+	for (uint32_t b = 0; b < Timing::Buckets; ++b) {
+		timing.histogram[b] = timing_histogram[b].exchange(0, std::memory_order_relaxed);
+	}
+	timing.voices_mixed = stats_voices_mixed.load(std::memory_order_relaxed);
+	timing.voices_virtual = stats_voices_virtual.load(std::memory_order_relaxed);
+	timing.voices_held = stats_voices_held.load(std::memory_order_relaxed);
+	timing.voices_stopped = stats_voices_stopped.load(std::memory_order_relaxed);
+	timing.peak = stats_peak.exchange(0.0f, std::memory_order_relaxed);
+	timing.clipped = stats_clipped.load(std::memory_order_relaxed);
+	return timing;
+}
 
 void Sound::lock() {
 	if (device) SDL_LockAudioDevice(device);
@@ -99,114 +479,544 @@ void Sound::unlock() {
 	if (device) SDL_UnlockAudioDevice(device);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play(Sample const &sample, float volume, float pan, Group group) {
+	return start(sample, volume, pan, glm::vec3(0.0f), 0.0f, false, false, group, 0);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius, Group group) {
+	return start(sample, volume, 0.0f, position, half_volume_radius, true, false, group, 0);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop(Sample const &sample, float volume, float pan, Group group) {
+	return start(sample, volume, pan, glm::vec3(0.0f), 0.0f, false, true, group, 0);
 }
 
+Sound::PlayingSample Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius, Group group) {
+	return start(sample, volume, 0.0f, position, half_volume_radius, true, true, group, 0);
+}
 
+Sound::PlayingSample Sound::play_at(Sample const &sample, uint64_t frame, float volume, float pan, Group group) {
+	return start(sample, volume, pan, glm::vec3(0.0f), 0.0f, false, false, group, frame);
+}
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play_3D_at(Sample const &sample, uint64_t frame, float volume, glm::vec3 const &position, float half_volume_radius, Group group) {
+	return start(sample, volume, 0.0f, position, half_volume_radius, true, false, group, frame);
 }
 
+Sound::PlayingSample Sound::loop_at(Sample const &sample, uint64_t frame, float volume, float pan, Group group) {
+	return start(sample, volume, pan, glm::vec3(0.0f), 0.0f, false, true, group, frame);
+}
 
-void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
+Sound::PlayingSample Sound::loop_3D_at(Sample const &sample, uint64_t frame, float volume, glm::vec3 const &position, float half_volume_radius, Group group) {
+	return start(sample, volume, 0.0f, position, half_volume_radius, true, true, group, frame);
+}
+
+uint64_t Sound::audio_clock() {
+	return audio_frames.load(std::memory_order_acquire);
+}
+
+Sound::Group Sound::add_group(Group parent, float volume) {
+	//(a group from before a shutdown, or one never returned by add_group(), mixes into master instead)
+	if (parent.index >= groups_created) parent = master;
+	if (groups_created == MaxGroups) {
+		std::cerr << "WARNING: no free mixer groups (at most " << MaxGroups << "); using the parent group instead." << std::endl;
+		return parent;
 	}
-	unlock();
+	Group group;
+	group.index = groups_created++;
+
+	Bus *bus = new Bus;
+	bus->parent = parent.index;
+	bus->volume = Ramp< float >(volume);
+	bus->buffer.assign(2 * MaxMixSamples, 0.0f);
+
+	Command command(Command::AddGroup);
+	command.group = group.index;
+	command.bus = bus;
+	enqueue(std::move(command));
+
+	return group;
+}
+
+
+void Sound::stop_all_samples() {
+	enqueue(Command(Command::StopAll));
 }
 
 void Sound::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	Command command(Command::SetGlobalVolume);
+	command.value = new_volume;
+	command.ramp = ramp;
+	enqueue(std::move(command));
+}
+
+void Sound::set_reverb(Sample const &impulse_response) {
+	if (impulse_response.stream) {
+		throw std::runtime_error("Reverb impulse response can't be a streamed sample.");
+	}
+	free_retired_reverbs();
+
+	//decode (whatever the encoding) and build the filter here, so the audio callback just swaps it in:
+	reverb_ir.resize(impulse_response.size());
+	AdpcmCursor cursor;
+	read_samples(impulse_response, 0, uint32_t(reverb_ir.size()), reverb_ir.data(), &cursor);
+
+	Command command(Command::SetReverb);
+	command.reverb = new Convolver(reverb_ir.data(), reverb_ir.size(), block_size);
+	enqueue(std::move(command));
+}
+
+void Sound::clear_reverb() {
+	free_retired_reverbs();
+	reverb_ir.clear();
+	enqueue(Command(Command::SetReverb));
+}
+
+void Sound::set_reverb_volume(float new_volume, float ramp) {
+	Command command(Command::SetReverbVolume);
+	command.value = new_volume;
+	command.ramp = ramp;
+	enqueue(std::move(command));
 }
 
 //------------------
+//NOTE: checks on voice state (2D vs 3D, stopping, handle still current) happen when the audio callback applies the command.
+
+void Sound::PlayingSample::set_volume(float new_volume, float ramp) const {
+	if (!*this) return;
+	Command command(Command::SetVolume, *this);
+	command.value = new_volume;
+	command.ramp = ramp;
+	enqueue(std::move(command));
+}
 
-void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
-	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
-	}
-	Sound::unlock();
+void Sound::PlayingSample::set_pan(float new_pan, float ramp) const {
+	if (!*this) return;
+	Command command(Command::SetPan, *this);
+	command.value = new_pan;
+	command.ramp = ramp;
+	enqueue(std::move(command));
 }
 
-void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
-	Sound::lock();
-	pan.set(new_pan, ramp);
-	Sound::unlock();
+void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) const {
+	if (!*this) return;
+	Command command(Command::SetPosition, *this);
+	command.position = new_position;
+	command.ramp = ramp;
+	enqueue(std::move(command));
 }
 
-void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	position.set(new_position, ramp);
-	Sound::unlock();
+void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) const {
+	if (!*this) return;
+	Command command(Command::SetHalfVolumeRadius, *this);
+	command.value = new_radius;
+	command.ramp = ramp;
+	enqueue(std::move(command));
 }
 
-void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
-	Sound::unlock();
+void Sound::PlayingSample::set_rate(float new_rate, float ramp) const {
+	if (!*this) return;
+	Command command(Command::SetRate, *this);
+	command.value = new_rate;
+	command.ramp = ramp;
+	enqueue(std::move(command));
 }
 
-void Sound::PlayingSample::stop(float ramp) {
-	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
-	}
-	Sound::unlock();
+void Sound::PlayingSample::set_doppler(bool enabled) const {
+	if (!*this) return;
+	Command command(Command::SetDoppler, *this);
+	command.value = (enabled ? 1.0f : 0.0f);
+	enqueue(std::move(command));
+}
+
+void Sound::PlayingSample::stop_at(uint64_t frame) const {
+	if (!*this) return;
+	Command command(Command::StopAt, *this);
+	command.at = frame;
+	enqueue(std::move(command));
+}
+
+void Sound::PlayingSample::set_reverb_send(float new_send, float ramp) const {
+	if (!*this) return;
+	Command command(Command::SetReverbSend, *this);
+	command.value = new_send;
+	command.ramp = ramp;
+	enqueue(std::move(command));
+}
+
+void Sound::PlayingSample::stop(float ramp) const {
+	if (!*this) return;
+	Command command(Command::Stop, *this);
+	command.ramp = ramp;
+	enqueue(std::move(command));
+}
+
+bool Sound::PlayingSample::stopped() const {
+	if (!*this) return true;
+	return slots[slot].generation.load(std::memory_order_acquire) != generation;
+}
+
+//------------------
+
+void Sound::Group::set_volume(float new_volume, float ramp) const {
+	Command command(Command::SetGroupVolume);
+	command.group = index;
+	command.value = new_volume;
+	command.ramp = ramp;
+	enqueue(std::move(command));
+}
+
+void Sound::Group::set_paused(bool paused, float ramp) const {
+	Command command(Command::SetGroupPaused);
+	command.group = index;
+	command.value = (paused ? 1.0f : 0.0f);
+	command.ramp = ramp;
+	enqueue(std::move(command));
+}
+
+void Sound::Group::set_limiter(float threshold, float release) const {
+	Command command(Command::SetGroupLimiter);
+	command.group = index;
+	command.value = (threshold > 0.0f ? threshold : std::numeric_limits< float >::infinity());
+	command.ramp = release;
+	enqueue(std::move(command));
 }
 
 //------------------
 
 void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
-	Sound::lock();
-	position.set(new_position, ramp);
+	Command command(Command::SetListener);
+	command.position = new_position;
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
+		command.right = glm::vec3(1.0f, 0.0f, 0.0f);
 	} else {
-		right.set(glm::normalize(new_right), ramp);
+		command.right = glm::normalize(new_right);
 	}
-	Sound::unlock();
+	command.ramp = ramp;
+	enqueue(std::move(command));
 }
 
 //------------------------ internals --------------------------------
 
+//helper: open the audio device (mixing 'block_size' frames per callback) and start playback:
+void open_device() {
+	//Based on the example on https://wiki.libsdl.org/SDL_OpenAudioDevice
+	SDL_AudioSpec want, have;
+	SDL_zero(want);
+	want.freq = AUDIO_RATE;
+	want.format = AUDIO_F32SYS;
+	want.channels = 2;
+	want.samples = uint16_t(block_size);
+	want.callback = mix_audio;
+
+	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+	if (device == 0) {
+		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
+		std::cerr << "  (Will continue without audio.)\n" << std::endl;
+	} else {
+		//start audio playback:
+		SDL_PauseAudioDevice(device, 0);
+	}
+}
+
+//helper: allocate the voice pool and handle slots:
+void setup_voices(Sound::Settings const &settings_) {
+	if (slots) {
+		std::cerr << "WARNING: Sound voices were already set up (was a sample played before Sound::init()?); ignoring new settings." << std::endl;
+		return;
+	}
+	settings = settings_;
+	if (settings.max_voices == 0 || settings.max_voices > MaxVoices) {
+		std::cerr << "WARNING: Sound max_voices of " << settings.max_voices << " is out of range; clamping to [1," << MaxVoices << "]." << std::endl;
+		settings.max_voices = std::max(1U, std::min(MaxVoices, settings.max_voices));
+	}
+
+	voices.reserve(settings.max_voices + StealHeadroom);
+	spatial = Spatializer(settings.max_voices + StealHeadroom);
+
+	slot_count = 2 * settings.max_voices;
+	slots.reset(new Slot[slot_count]);
+	free_slots.reserve(slot_count);
+	for (uint32_t s = slot_count; s > 0; --s) {
+		free_slots.emplace_back(s - 1);
+	}
+}
+
+//helper: (game thread) get a handle slot and queue a 'Play' command for it:
+Sound::PlayingSample start(Sound::Sample const &sample, float volume, float pan, glm::vec3 const &position, float half_volume_radius, bool is_3D, bool loop, Sound::Group group, uint64_t at) {
+	if (!slots) setup_voices(Sound::Settings()); //samples played without calling Sound::init() get the default pool
+
+	//collect any slots the audio thread has finished with:
+	uint32_t freed;
+	while (freed_slots.pop(&freed)) {
+		free_slots.emplace_back(freed);
+	}
+
+	Sound::PlayingSample handle;
+	if (free_slots.empty()) {
+		std::cerr << "WARNING: no free voice slots (too many samples started at once?); not playing sample." << std::endl;
+		return handle;
+	}
+	handle.slot = free_slots.back();
+	free_slots.pop_back();
+	handle.generation = slots[handle.slot].generation.load(std::memory_order_acquire);
+
+	Command command(Command::Play, handle);
+	command.sample = &sample;
+	command.value = volume;
+	command.pan = pan;
+	command.position = position;
+	command.half_volume_radius = half_volume_radius;
+	command.is_3D = is_3D;
+	command.loop = loop;
+	command.group = (group.index < groups_created ? group.index : 0);
+	command.at = at;
+	if (sample.stream) {
+		command.stream_serial = sample.stream->restart(loop);
+	}
+	sample.voices.fetch_add(1, std::memory_order_relaxed); //(the mixer counts it back down when the voice ends)
+	enqueue(std::move(command));
+
+	return handle;
+}
+
+//helper: look up the voice a handle refers to (nullptr if playback has ended):
+Voice *find_voice(uint32_t slot, uint32_t generation) {
+	if (slot >= slot_count) return nullptr;
+	Slot &s = slots[slot];
+	if (s.voice == -1U || s.generation.load(std::memory_order_relaxed) != generation) return nullptr;
+	return &voices[s.voice];
+}
+
+//helper: invalidate a handle slot (so outstanding handles go stale) and give it back to the game thread:
+void release_slot(uint32_t slot) {
+	Slot &s = slots[slot];
+	s.voice = -1U;
+	s.generation.fetch_add(1, std::memory_order_release);
+	bool pushed = freed_slots.push(uint32_t(slot));
+	assert(pushed && "freed_slots can hold every slot, so can't overflow");
+	(void)pushed;
+}
+
+//helper: remove voices[v] by moving the last voice into its place:
+void remove_voice(uint32_t v) {
+	assert(v < voices.size());
+	voices[v].sample->voices.fetch_sub(1, std::memory_order_release);
+	if (voices[v].slot != -1U) {
+		release_slot(voices[v].slot);
+	} else {
+		--voices_stolen; //(handle was released when it was stolen)
+	}
+	if (v + 1 != voices.size()) {
+		voices[v] = voices.back();
+		if (voices[v].slot != -1U) slots[voices[v].slot].voice = v;
+	}
+	voices.pop_back();
+	stats_voices_stopped.fetch_add(1, std::memory_order_relaxed);
+}
+
+//helper: pick the voice to replace when all voices are busy:
+// (from those not already stolen)
+uint32_t choose_voice_to_steal() {
+	uint32_t best = -1U;
+	for (uint32_t v = 0; v < voices.size(); ++v) {
+		if (voices[v].slot == -1U) continue;
+		if (best == -1U) {
+			best = v;
+		} else if (settings.steal == Sound::Settings::Steal::Oldest) {
+			if (voices[v].started < voices[best].started) best = v;
+		} else { //Quietest
+			if (voices[v].gain < voices[best].gain) best = v;
+		}
+	}
+	assert(best != -1U && "only called when max_voices voices are playing");
+	return best;
+}
+
+//helper: fade out a voice over 'ramp' seconds (it is removed once silent):
+void stop_voice(Voice &voice, float ramp) {
+	if (!voice.stopping) {
+		voice.stopping = true;
+		voice.volume.target = 0.0f;
+		voice.volume.ramp = ramp;
+	} else {
+		voice.volume.ramp = std::min(voice.volume.ramp, ramp);
+	}
+}
+
+//helper: apply a command queued by the game thread.
+// (called from the audio callback, or with the audio device locked)
+void apply_command(Command &command) {
+	if (command.type == Command::Play) {
+		if (command.sample->size() == 0 && !command.sample->stream) { //nothing to play; playback is over already
+			command.sample->voices.fetch_sub(1, std::memory_order_release);
+			release_slot(command.slot);
+			return;
+		}
+		uint32_t v;
+		if (voices.size() - voices_stolen < settings.max_voices) {
+			//(if fewer than max_voices are playing, at most StealHeadroom - 1 are stolen, so there is room)
+			v = uint32_t(voices.size());
+			voices.emplace_back();
+		} else {
+			v = choose_voice_to_steal();
+			release_slot(voices[v].slot);
+			if (voices_stolen < StealHeadroom) {
+				//fade the stolen voice out, and play in a new one:
+				voices[v].slot = -1U;
+				stop_voice(voices[v], StealFade);
+				++voices_stolen;
+				v = uint32_t(voices.size());
+				voices.emplace_back();
+			} else {
+				//too many stolen voices fading out already (lots of plays at once); cut this one off:
+				voices[v].sample->voices.fetch_sub(1, std::memory_order_release);
+				stats_voices_stopped.fetch_add(1, std::memory_order_relaxed); //(as remove_voice() would)
+				voices[v] = Voice();
+			}
+		}
+		Voice &voice = voices[v];
+		voice.sample = command.sample;
+		voice.stream_serial = command.stream_serial;
+		voice.loop = command.loop;
+		voice.group = command.group;
+		voice.start_at = command.at;
+		voice.volume = Sound::Ramp< float >(command.value);
+		if (command.is_3D) {
+			voice.position = Sound::Ramp< glm::vec3 >(command.position);
+			voice.half_volume_radius = Sound::Ramp< float >(command.half_volume_radius);
+		} else {
+			voice.pan = Sound::Ramp< float >(command.pan);
+		}
+		voice.slot = command.slot;
+		voice.started = voices_started++;
+		voice.gain = command.value; //(upper bound until the voice is actually mixed)
+		slots[command.slot].voice = v;
+		return;
+	}
+
+	if (command.type == Command::StopAll) {
+		for (auto &voice : voices) {
+			stop_voice(voice, 1.0f / 60.0f);
+		}
+		return;
+	}
+	if (command.type == Command::SetGlobalVolume) {
+		Sound::volume.set(command.value, command.ramp);
+		return;
+	}
+	if (command.type == Command::SetListener) {
+		Sound::listener.position.set(command.position, command.ramp);
+		Sound::listener.right.set(command.right, command.ramp);
+		return;
+	}
+	if (command.type == Command::SetReverb) {
+		if (Convolver *old = reverb) {
+			if (!retired_reverbs.push(std::move(old))) {
+				delete old; //(game thread hasn't been collecting them; free it here rather than leak it)
+			}
+		}
+		reverb = command.reverb;
+		return;
+	}
+	if (command.type == Command::SetReverbVolume) {
+		Sound::reverb_volume.set(command.value, command.ramp);
+		return;
+	}
+	if (command.type == Command::AddGroup) {
+		//(groups are numbered in creation order, so they arrive in order)
+		assert(command.group == bus_count && command.group < MaxGroups);
+		buses[command.group] = command.bus;
+		bus_count = command.group + 1;
+		return;
+	}
+	if (command.type == Command::SetGroupVolume || command.type == Command::SetGroupPaused || command.type == Command::SetGroupLimiter) {
+		if (command.group >= bus_count) return; //(group from before a shutdown)
+		Bus &bus = *buses[command.group];
+		if (command.type == Command::SetGroupVolume) {
+			bus.volume.set(command.value, command.ramp);
+		} else if (command.type == Command::SetGroupPaused) {
+			bus.paused = (command.value != 0.0f);
+			bus.fade.set(bus.paused ? 0.0f : 1.0f, command.ramp);
+		} else {
+			if (&bus == &master_bus && bus.threshold == std::numeric_limits< float >::infinity()) {
+				master_limiter.reset(); //(turning on: anything left in the delay is from long ago)
+			}
+			bus.threshold = command.value;
+			bus.limiter_gain = 1.0f;
+			//exponential recovery, reaching ~63% of the way back to unity gain in 'release' seconds:
+			bus.release = (command.ramp > 0.0f ? 1.0f - std::exp(-1.0f / (command.ramp * AUDIO_RATE)) : 1.0f);
+		}
+		return;
+	}
+
+	//remaining commands apply to a voice, which might have finished (or been stolen) since the command was queued:
+	Voice *voice = find_voice(command.slot, command.generation);
+	if (!voice) return;
+	switch (command.type) {
+		case Command::SetVolume:
+			if (!voice->stopping) {
+				voice->volume.set(command.value, command.ramp);
+			}
+			break;
+		case Command::SetPan:
+			if (!(voice->pan.value == voice->pan.value)) break; //ignore if not in '2D' mode
+			voice->pan.set(command.value, command.ramp);
+			break;
+		case Command::SetPosition:
+			if (voice->pan.value == voice->pan.value) break; //ignore if not in '3D' mode
+			voice->position.set(command.position, command.ramp);
+			break;
+		case Command::SetHalfVolumeRadius:
+			if (voice->pan.value == voice->pan.value) break; //ignore if not in '3D' mode
+			voice->half_volume_radius.set(command.value, command.ramp);
+			break;
+		case Command::SetRate:
+			voice->rate.set(std::max(0.0f, std::min(MaxRate, command.value)), command.ramp);
+			if (command.ramp <= 0.0f) voice->block_rate = voice->rate.value; //(no glide from the old rate, either)
+			break;
+		case Command::SetDoppler:
+			if (voice->pan.value == voice->pan.value) break; //ignore if not in '3D' mode
+			voice->doppler = (command.value != 0.0f);
+			break;
+		case Command::StopAt:
+			voice->stop_at = command.at;
+			break;
+		case Command::SetReverbSend:
+			voice->reverb_send.set(std::max(0.0f, std::min(1.0f, command.value)), command.ramp);
+			break;
+		case Command::Stop:
+			stop_voice(*voice, command.ramp);
+			break;
+		default:
+			assert(0 && "non-voice commands handled above");
+	}
+}
+
+//helper: (game thread) free reverbs the audio thread has finished with:
+void free_retired_reverbs() {
+	Convolver *retired;
+	while (retired_reverbs.pop(&retired)) {
+		delete retired;
+	}
+}
+
+//helper: queue a command for the audio callback.
+void enqueue(Command &&command) {
+	if (commands.push(std::move(command))) return;
+
+	//Queue is full (audio callback stalled, or no audio device): lock out the callback and
+	// drain the queue on this thread instead. This is the only path that takes the audio lock.
+	Sound::lock();
+	Command pending;
+	while (commands.pop(&pending)) {
+		apply_command(pending);
+	}
+	apply_command(command);
+	Sound::unlock();
+}
+
 
 //helper: equal-power panning
 inline void compute_pan_weights(float pan, float *left, float *right) {
@@ -219,66 +1029,62 @@ inline void compute_pan_weights(float pan, float *left, float *right) {
 	*right = std::sin(ang);
 }
 
-//helper: 3D audio panning
-void compute_pan_from_listener_and_position(
-	glm::vec3 const &listener_position,
-	glm::vec3 const &listener_right,
-	glm::vec3 const &source_position,
-	float source_half_radius,
-	float *left, float *right
-	) {
-	glm::vec3 to = source_position - listener_position;
-	float distance = glm::length(to);
-	//start by panning based on direction.
-	//note that for a LR fade to sound uniform, sound power (squared magnitude) should remain constant.
-	if (distance == 0.0f) {
-		*left = *right = std::sqrt(2.0f);
+//helper: move a voice's playback position forward by 'count' (possibly fractional) samples without mixing them;
+// returns true if playback has finished.
+bool advance_voice(Voice &voice, double count) {
+	if (OpusStream *stream = voice.sample->stream.get()) {
+		//decoded samples still need to be taken, so the stream stays in step with the playback position:
+		// (streams always play at rate 1, so 'count' is whole here)
+		for (uint32_t remaining = uint32_t(count); remaining > 0; /* later */) {
+			float const *span_data = nullptr;
+			uint32_t span = stream->peek(voice.stream_serial, &span_data, remaining);
+			if (span == 0) break;
+			stream->consume(span);
+			remaining -= span;
+		}
+		return stream->finished(voice.stream_serial);
 	} else {
-		//amt ranges from -1 (most left) to 1 (most right):
-		float amt = glm::dot(listener_right, to) / distance;
-		//turn into an angle from 0.0f (most left) to pi/2 (most right):
-		float ang = 0.5f * 3.1415926f * (0.5f * (amt + 1.0f));
-		*left = std::cos(ang);
-		*right = std::sin(ang);
-
-		//squared distance attenuation is realistic if there are no walls,
-		// but I'm going to use linear because it's sounds better to me.
-		// (feel free to change it, of course)
-		//want att = 0.5f at distance == half_volume_radius
-		float att = 1.0f / (1.0f + (distance / source_half_radius));
-		*left *= att;
-		*right *= att;
+		uint32_t size = uint32_t(voice.sample->size());
+		assert(voice.i < size);
+		double position = double(voice.frac) + count;
+		uint64_t whole = uint64_t(position);
+		voice.frac = float(position - double(whole));
+		if (voice.loop) {
+			voice.i = uint32_t((uint64_t(voice.i) + whole) % size);
+		} else {
+			voice.i = uint32_t(std::min< uint64_t >(size, uint64_t(voice.i) + whole));
+		}
+		return voice.i >= size;
 	}
 }
 
-//helper: ramp updates...
-constexpr float const RAMP_STEP = float(MIX_SAMPLES) / float(AUDIO_RATE);
+//helper: ramp updates (by 'ramp_step' seconds)...
 
 //helper: ...for single values:
 void step_value_ramp(Sound::Ramp< float > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+	if (ramp.ramp < ramp_step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value += (RAMP_STEP / ramp.ramp) * (ramp.target - ramp.value);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value += (ramp_step / ramp.ramp) * (ramp.target - ramp.value);
+		ramp.ramp -= ramp_step;
 	}
 }
 
 //helper: ...for 3D positions:
 void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+	if (ramp.ramp < ramp_step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value = glm::mix(ramp.value, ramp.target, RAMP_STEP / ramp.ramp);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value = glm::mix(ramp.value, ramp.target, ramp_step / ramp.ramp);
+		ramp.ramp -= ramp_step;
 	}
 }
 
 //helper: ...for 3D directions:
 void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+	if (ramp.ramp < ramp_step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
@@ -302,31 +1108,219 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 		float angle = std::acos(glm::clamp(glm::dot(ramp.value, ramp.target), -1.0f, 1.0f));
 
 		//figure out new target value by moving angle toward target:
-		angle *= (ramp.ramp - RAMP_STEP) / ramp.ramp;
+		angle *= (ramp.ramp - ramp_step) / ramp.ramp;
 
 		ramp.value = ramp.target * std::cos(angle) + perp * std::sin(angle);
-		ramp.ramp -= RAMP_STEP;
+		ramp.ramp -= ramp_step;
+	}
+}
+
+//helper: Doppler shift (ratio of heard to emitted frequency) for a source and listener that
+// moved from their start to end positions over the last ramp_step seconds:
+float doppler_factor(
+	glm::vec3 const &listener_start, glm::vec3 const &listener_end,
+	glm::vec3 const &source_start, glm::vec3 const &source_end
+	) {
+	float c = settings.speed_of_sound;
+	glm::vec3 to = source_end - listener_end;
+	float distance = glm::length(to);
+	if (!(c > 0.0f) || distance == 0.0f) return 1.0f;
+	glm::vec3 dir = to / distance;
+
+	//speeds toward each other along the line between them:
+	// (limited to half the speed of sound, so a teleport gives a bounded chirp rather than a wild one)
+	float listener_speed = glm::dot(listener_end - listener_start, dir) / ramp_step;
+	float source_speed = -glm::dot(source_end - source_start, dir) / ramp_step;
+	listener_speed = std::max(-0.5f * c, std::min(0.5f * c, listener_speed));
+	source_speed = std::max(-0.5f * c, std::min(0.5f * c, source_speed));
+
+	return (c + listener_speed) / (c - source_speed);
+}
+
+//helper: gains for mixing a voice into the output and (if 'send' isn't null) the reverb input;
+// each moves from its start value by its step every frame, continuing from call to call:
+struct VoiceMix {
+	float *out = nullptr; //next output frame
+	float l = 0.0f, r = 0.0f, step_l = 0.0f, step_r = 0.0f;
+
+	float *send = nullptr; //next reverb input frame
+	float send_l = 0.0f, send_r = 0.0f, send_step_l = 0.0f, send_step_r = 0.0f;
+
+	//mix the next 'count' frames:
+	void mix(float const *data, uint32_t count) {
+		mix_mono(data, count, out, &l, &r, step_l, step_r);
+		out += 2 * count;
+		if (send) {
+			mix_mono(data, count, send, &send_l, &send_r, send_step_l, send_step_r);
+			send += 2 * count;
+		}
+	}
+	void mix(int16_t const *data, uint32_t count) {
+		mix_mono_i16(data, count, out, &l, &r, step_l, step_r);
+		out += 2 * count;
+		if (send) {
+			mix_mono_i16(data, count, send, &send_l, &send_r, send_step_l, send_step_r);
+			send += 2 * count;
+		}
+	}
+};
+
+//helper: apply a group's gain and limiter to its mix (2 * block_size interleaved values):
+void process_bus(Bus &bus, float *data) {
+	if (bus.start_gain != 1.0f || bus.end_gain != 1.0f) {
+		float gain = bus.start_gain;
+		float const step = (bus.end_gain - bus.start_gain) / block_size;
+		for (uint32_t s = 0; s < block_size; ++s) {
+			data[2 * s + 0] *= gain;
+			data[2 * s + 1] *= gain;
+			gain += step;
+		}
 	}
+	if (bus.threshold != std::numeric_limits< float >::infinity() && &bus == &master_bus) {
+		//the output's limiter looks ahead, so it can ease into gain reduction (at the cost of a little latency):
+		master_limiter.process(data, block_size, bus.threshold, bus.release);
+	} else if (bus.threshold != std::numeric_limits< float >::infinity()) {
+		//peak limiter: gain drops instantly to hold a peak at the threshold, then recovers exponentially:
+		float gain = bus.limiter_gain;
+		for (uint32_t s = 0; s < block_size; ++s) {
+			float peak = std::max(std::abs(data[2 * s + 0]), std::abs(data[2 * s + 1]));
+			float target = (peak > bus.threshold ? bus.threshold / peak : 1.0f);
+			if (target < gain) {
+				gain = target;
+			} else {
+				gain += (target - gain) * bus.release;
+			}
+			data[2 * s + 0] *= gain;
+			data[2 * s + 1] *= gain;
+		}
+		bus.limiter_gain = gain;
+	}
+}
+
+//helper: how far 'count' outputs played at a rate moving linearly from 'start_rate' to 'end_rate' move the playback position:
+// (output s plays at start_rate + s * (end_rate - start_rate) / count)
+double block_advance(float start_rate, float end_rate, uint32_t count) {
+	return count * double(start_rate) + 0.5 * (double(count) - 1.0) * (double(end_rate) - double(start_rate));
 }
 
+//helper: copy samples [begin, begin+count) of a (non-streamed) sample into 'out' as floats:
+void read_samples(Sound::Sample const &sample, uint32_t begin, uint32_t count, float *out, AdpcmCursor *cursor) {
+	assert(begin + count <= sample.size());
+	if (sample.encoding == Sound::Sample::Int16) {
+		int16_t const *src = sample.data_i16.data() + begin;
+		for (uint32_t s = 0; s < count; ++s) {
+			out[s] = float(src[s]) * (1.0f / 32768.0f);
+		}
+	} else if (sample.encoding == Sound::Sample::ADPCM) {
+		adpcm_decode(sample.data_adpcm.data(), begin, count, out, cursor);
+	} else {
+		std::copy(sample.data.data() + begin, sample.data.data() + begin + count, out);
+	}
+}
+
+//helper: mix 'count' outputs of a (non-streamed) voice with its playback rate moving linearly from
+// 'start_rate' to 'end_rate', resampling with 4-point (Catmull-Rom) interpolation around the fractional position;
+// returns true if playback has finished.
+bool mix_resampled(Voice &voice, float start_rate, float end_rate, uint32_t count, VoiceMix &mix) {
+	Sound::Sample const &sample = *voice.sample;
+	uint32_t size = uint32_t(sample.size());
+	assert(voice.i < size);
+
+	//output s reads from position voice.frac + (rate at outputs 0 .. s-1), relative to voice.i:
+	double rate = start_rate;
+	double const rate_step = (double(end_rate) - double(start_rate)) / count;
+	double const end = double(voice.frac) + block_advance(start_rate, end_rate, count);
+
+	//gather the sample data the block touches -- starting one before 'i', for the interpolation -- into a scratch buffer:
+	// (wrapping around if looping, silence past the end if not)
+	static float input[uint32_t(MaxRate) * MaxMixSamples + 8];
+	uint32_t const needed = std::min(uint32_t(end) + 5, uint32_t(sizeof(input) / sizeof(input[0]))); //(one spare, for rounding)
+	if (voice.i > 0) {
+		read_samples(sample, voice.i - 1, 1, input, &voice.adpcm);
+	} else if (voice.loop) {
+		read_samples(sample, size - 1, 1, input, &voice.adpcm);
+	} else {
+		input[0] = 0.0f;
+	}
+	uint32_t at = voice.i;
+	for (uint32_t got = 1; got < needed; /* later */) {
+		if (at == size) {
+			if (voice.loop) {
+				at = 0;
+			} else {
+				std::fill(input + got, input + needed, 0.0f);
+				break;
+			}
+		}
+		uint32_t span = std::min(needed - got, size - at);
+		read_samples(sample, at, span, input + got, &voice.adpcm);
+		got += span;
+		at += span;
+	}
+
+	//resample:
+	static float resampled[MaxMixSamples];
+	double position = voice.frac;
+	for (uint32_t s = 0; s < count; ++s) {
+		uint32_t k = uint32_t(position);
+		float t = float(position - double(k));
+		float const *x = input + k; //x[1] is the sample at or just before 'position'
+		float c1 = 0.5f * (x[2] - x[0]);
+		float c2 = x[0] - 2.5f * x[1] + 2.0f * x[2] - 0.5f * x[3];
+		float c3 = 0.5f * (x[3] - x[0]) + 1.5f * (x[1] - x[2]);
+		resampled[s] = ((c3 * t + c2) * t + c1) * t + x[1];
+		position += rate;
+		rate += rate_step;
+	}
+
+	mix.mix(resampled, count);
+
+	return advance_voice(voice, position - double(voice.frac));
+}
 
 //The audio callback -- invoked by SDL when it needs more sound to play:
 void mix_audio(void *, Uint8 *buffer_, int len) {
 	assert(buffer_); //should always have some audio buffer
+	auto before = std::chrono::steady_clock::now();
+
+	//with a device, callbacks should come about a block apart; much longer means the device probably ran out of audio:
+	// (render() is called whenever its caller likes, so isn't checked)
+	if (device && blocks_since_open >= WarmupBlocks
+	 && std::chrono::duration< float >(before - last_callback).count() > 2.0f * ramp_step) {
+		timing_late.fetch_add(1, std::memory_order_relaxed);
+	}
+	last_callback = before;
+	uint32_t voices_mixed = 0, voices_virtual = 0, voices_held = 0;
+
+	//virtual voices (see Settings::audible_gain) are dropped from the mix, so the output is off by their sum;
+	// they share this budget, so that sum stays below audible_gain however many of them there are:
+	float virtual_budget = settings.audible_gain;
 
 	struct LR {
 		float l;
 		float r;
 	};
 	static_assert(sizeof(LR) == 8, "Sample is packed");
-	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
+	assert(size_t(len) == block_size * sizeof(LR)); //should always have the expected number of samples
 	LR *buffer = reinterpret_cast< LR * >(buffer_);
 
+	//apply any changes queued by the game thread:
+	Command command;
+	while (commands.pop(&command)) {
+		apply_command(command);
+	}
+
+	//audio clock at the start of this block:
+	uint64_t const block_start = audio_frames.load(std::memory_order_relaxed);
+
 	//zero the output buffer:
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+	for (uint32_t s = 0; s < block_size; ++s) {
 		buffer[s].l = 0.0f;
 		buffer[s].r = 0.0f;
 	}
+	if (reverb) {
+		std::fill(reverb_input, reverb_input + 2 * block_size, 0.0f);
+	}
 
 	//update global values:
 	float start_volume = Sound::volume.value;
@@ -341,98 +1335,321 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	glm::vec3 end_position =  Sound::listener.position.value;
 	glm::vec3 end_right =  Sound::listener.right.value;
 
-	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
+	//(the reverb return volume is also needed for the virtual voice check, below)
+	float start_reverb_volume = Sound::reverb_volume.value;
+	step_value_ramp(Sound::reverb_volume);
+	float end_reverb_volume = Sound::reverb_volume.value;
+
+	//update groups: (parents come before their subgroups)
+	for (uint32_t g = 0; g < bus_count; ++g) {
+		Bus &bus = *buses[g];
+		bus.frozen = (bus.paused && bus.fade.value == 0.0f);
+		bus.start_gain = bus.volume.value * bus.fade.value;
+		step_value_ramp(bus.volume);
+		step_value_ramp(bus.fade);
+		bus.end_gain = bus.volume.value * bus.fade.value;
+
+		bus.out = (g == 0 ? &buffer[0].l : bus.buffer.data());
+		bus.mixed = false;
+		bus.start_total = bus.start_gain;
+		bus.end_total = bus.end_gain;
+		bus.start_send = 1.0f;
+		bus.end_send = 1.0f;
+		if (g != 0) {
+			Bus const &parent = *buses[bus.parent];
+			bus.frozen = bus.frozen || parent.frozen;
+			bus.start_total *= parent.start_total;
+			bus.end_total *= parent.end_total;
+			bus.start_send = bus.start_gain * parent.start_send;
+			bus.end_send = bus.end_gain * parent.end_send;
+		}
+	}
+
+	//gather the 3D voices that will play this block (see the checks below), then
+	// step their position ramps and compute their start and end pans all at once:
+	spatial.count = 0;
+	for (Voice &voice : voices) {
+		if (voice.pan.value == voice.pan.value) continue; //(2D)
+		if (buses[voice.group]->frozen || voice.start_at >= block_start + block_size) continue;
+		uint32_t k = spatial.count++;
+		voice.spatial = k;
+		spatial.x[k] = voice.position.value.x;
+		spatial.y[k] = voice.position.value.y;
+		spatial.z[k] = voice.position.value.z;
+		spatial.target_x[k] = voice.position.target.x;
+		spatial.target_y[k] = voice.position.target.y;
+		spatial.target_z[k] = voice.position.target.z;
+		spatial.position_ramp[k] = voice.position.ramp;
+		spatial.radius[k] = voice.half_volume_radius.value;
+		spatial.radius_target[k] = voice.half_volume_radius.target;
+		spatial.radius_ramp[k] = voice.half_volume_radius.ramp;
+	}
+	spatial.run(start_position, start_right, end_position, end_right, ramp_step);
+
+	//add audio from each playing voice into its group's buffer:
+	for (uint32_t v = 0; v < voices.size(); /* later */) {
+		Voice &voice = voices[v];
+		Bus &bus = *buses[voice.group];
+
+		if (bus.frozen) {
+			//group is paused: hold playback where it is. (a stopped voice can go, though -- it's silent anyway)
+			if (voice.stopping) {
+				remove_voice(v);
+			} else {
+				++voices_held;
+				++v;
+			}
+			continue;
+		}
+
+		//scheduled voices (see Sound::play_at, PlayingSample::stop_at) only play frames [begin, end) of this block:
+		uint32_t begin = 0;
+		if (voice.start_at > block_start) {
+			if (voice.start_at - block_start >= block_size) {
+				//not started yet (or stopped before it started):
+				if (voice.stopping) {
+					remove_voice(v);
+				} else {
+					++voices_held;
+					++v;
+				}
+				continue;
+			}
+			begin = uint32_t(voice.start_at - block_start);
+		}
+		uint32_t end = block_size;
+		if (voice.stop_at < block_start + block_size) {
+			end = uint32_t(std::max(voice.stop_at, block_start + begin) - block_start);
+		}
+		uint32_t const count = end - begin;
 
 		//Figure out sample panning/volume at start...
 		LR start_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
-			//3D panning
-			compute_pan_from_listener_and_position(
-				start_position, start_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
-				&start_pan.l, &start_pan.r);
-
-			step_position_ramp(playing_sample.position);
-			step_value_ramp(playing_sample.half_volume_radius);
+		glm::vec3 start_source = voice.position.value;
+		if (!(voice.pan.value == voice.pan.value)) {
+			//3D panning (computed above, along with the ramp steps):
+			uint32_t k = voice.spatial;
+			start_pan.l = spatial.start_l[k];
+			start_pan.r = spatial.start_r[k];
+
+			voice.position.value = glm::vec3(spatial.end_x[k], spatial.end_y[k], spatial.end_z[k]);
+			voice.position.ramp = spatial.position_ramp[k];
+			voice.half_volume_radius.value = spatial.radius[k];
+			voice.half_volume_radius.ramp = spatial.radius_ramp[k];
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
+			compute_pan_weights(voice.pan.value, &start_pan.l, &start_pan.r);
 
-			step_value_ramp(playing_sample.pan);
+			step_value_ramp(voice.pan);
 		}
-		start_pan.l *= start_volume * playing_sample.volume.value;
-		start_pan.r *= start_volume * playing_sample.volume.value;
+		start_pan.l *= start_volume * voice.volume.value;
+		start_pan.r *= start_volume * voice.volume.value;
+
+		float start_send = voice.reverb_send.value;
 
-		step_value_ramp(playing_sample.volume);
+		step_value_ramp(voice.volume);
+		step_value_ramp(voice.reverb_send);
 
 		//..and end of the mix period:
 		LR end_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
+		if (!(voice.pan.value == voice.pan.value)) {
 			//3D panning
-			compute_pan_from_listener_and_position(
-				end_position, end_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
-				&end_pan.l, &end_pan.r);
+			end_pan.l = spatial.end_l[voice.spatial];
+			end_pan.r = spatial.end_r[voice.spatial];
 		} else {
 			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
+			compute_pan_weights(voice.pan.value, &end_pan.l, &end_pan.r);
 		}
 
-		end_pan.l *= end_volume * playing_sample.volume.value;
-		end_pan.r *= end_volume * playing_sample.volume.value;
+		end_pan.l *= end_volume * voice.volume.value;
+		end_pan.r *= end_volume * voice.volume.value;
+
+		//playback rate moves smoothly from where it ended last block:
+		float start_rate = voice.block_rate;
+		step_value_ramp(voice.rate);
+		float end_rate = voice.rate.value;
+		if (voice.doppler) {
+			end_rate *= doppler_factor(start_position, end_position, start_source, voice.position.value);
+		}
+		end_rate = std::max(0.0f, std::min(MaxRate, end_rate));
+		voice.block_rate = end_rate;
+		//(rate 1 with no fractional position left over reads samples directly, below)
+		bool resample = !voice.sample->stream && (start_rate != 1.0f || end_rate != 1.0f || voice.frac != 0.0f);
 
 		//figure out a step to add at each sample so that pan will move smoothly from start to end:
-		LR pan = start_pan;
-		LR pan_step;
-		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
-		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
-
-		assert(playing_sample.i < playing_sample.data.size());
-
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
-
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
+		// (a voice starting partway through the block picks up the ramp from there)
+		VoiceMix mix;
+		mix.out = bus.out + 2 * begin;
+		mix.step_l = (end_pan.l - start_pan.l) / block_size;
+		mix.step_r = (end_pan.r - start_pan.r) / block_size;
+		mix.l = start_pan.l + mix.step_l * begin;
+		mix.r = start_pan.r + mix.step_r * begin;
+
+		//...and the same for the reverb send:
+		float end_send = voice.reverb_send.value;
+		if (reverb && (start_send > 0.0f || end_send > 0.0f)) {
+			mix.send = reverb_input + 2 * begin;
+			//(sends skip the voice's group and its parents, so apply their gains here -- but not master's,
+			// since the reverb return mixes into master before master's gain is applied)
+			start_send *= bus.start_send;
+			end_send *= bus.end_send;
+			mix.send_step_l = (end_pan.l * end_send - start_pan.l * start_send) / block_size;
+			mix.send_step_r = (end_pan.r * end_send - start_pan.r * start_send) / block_size;
+			mix.send_l = start_pan.l * start_send + mix.send_step_l * begin;
+			mix.send_r = start_pan.r * start_send + mix.send_step_r * begin;
+		}
+
+		bool finished;
+		float start_gain = std::max(start_pan.l, start_pan.r) * bus.start_total;
+		float end_gain = std::max(end_pan.l, end_pan.r) * bus.end_total;
+		if (mix.send) {
+			//a virtual voice's send is dropped too, so count what it would have added (through the reverb and master):
+			// (taking the reverb as unit gain -- its impulse response is applied as given)
+			start_gain += std::max(start_pan.l, start_pan.r) * start_send * start_reverb_volume * master_bus.start_gain;
+			end_gain += std::max(end_pan.l, end_pan.r) * end_send * end_reverb_volume * master_bus.end_gain;
+		}
+		if (count == 0) {
+			//stop_at came before this voice got to play at all:
+			finished = true;
+		} else if (std::max(start_gain, end_gain) < virtual_budget) {
+			//quiet enough for this whole block (and within what's left of the budget): advance playback without mixing ("virtual" voice).
+			// (pan still ramps from start_pan next block, so mixing resumes smoothly when it becomes audible)
+			virtual_budget -= std::max(start_gain, end_gain);
+			++voices_virtual;
+			if (resample) {
+				finished = advance_voice(voice, block_advance(start_rate, end_rate, count));
+			} else {
+				finished = advance_voice(voice, count);
+			}
+		} else if (resample) {
+			++voices_mixed;
+			bus.mixed = true;
+			finished = mix_resampled(voice, start_rate, end_rate, count, mix);
+		} else if (OpusStream *stream = voice.sample->stream.get()) {
+			//streamed sample: mix whatever the decoder has ready; the decoder handles looping.
+			// (if it has fallen behind, the rest of the block is left silent)
+			++voices_mixed;
+			bus.mixed = true;
+			for (uint32_t remaining = count; remaining > 0; /* later */) {
+				float const *span_data = nullptr;
+				uint32_t span = stream->peek(voice.stream_serial, &span_data, remaining);
+				if (span == 0) break;
+				mix.mix(span_data, span);
+				stream->consume(span);
+				remaining -= span;
+			}
+			finished = stream->finished(voice.stream_serial);
+		} else {
+			Sound::Sample const &sample = *voice.sample;
+			uint32_t size = uint32_t(sample.size());
+			assert(voice.i < size);
+			++voices_mixed;
+			bus.mixed = true;
+
+			//mix contiguous spans of the sample, so the loop-point check happens once per span rather than once per sample:
+			for (uint32_t remaining = count; remaining > 0; /* later */) {
+				uint32_t span = std::min(remaining, size - voice.i);
+				if (sample.encoding == Sound::Sample::Int16) {
+					mix.mix(sample.data_i16.data() + voice.i, span);
+				} else if (sample.encoding == Sound::Sample::ADPCM) {
+					//decode into a (cache-resident) scratch buffer, then mix as float:
+					static float decoded[MaxMixSamples];
+					adpcm_decode(sample.data_adpcm.data(), voice.i, span, decoded, &voice.adpcm);
+					mix.mix(decoded, span);
 				} else {
-					break;
+					mix.mix(sample.data.data() + voice.i, span);
+				}
+				remaining -= span;
+
+				//update position in sample:
+				voice.i += span;
+				if (voice.i == size) {
+					if (voice.loop) {
+						voice.i = 0;
+					} else {
+						break;
+					}
 				}
 			}
-
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+			finished = (voice.i >= size);
 		}
 
-		if (playing_sample.i >= playing_sample.data.size()
-		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
+		//reached stop_at:
+		if (end < block_size) finished = true;
+
+		//remember how loud the voice is, for voice stealing:
+		// (as it will be heard -- a loud voice in a quiet group is quiet)
+		voice.gain = end_gain;
+
+		if (finished || (voice.stopping && voice.volume.value == 0.0f)) { //sample has finished
+			//remove from pool (last voice moves into slot 'v', so don't advance):
+			remove_voice(v);
 		} else {
-			++si;
+			++v;
 		}
 	}
 
-	/*//DEBUG: report output power:
-	float max_power = 0.0f;
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
-		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
+	//mix groups into their parents, subgroups first:
+	for (uint32_t g = bus_count - 1; g > 0; --g) {
+		Bus &bus = *buses[g];
+		if (!bus.mixed) continue;
+		process_bus(bus, bus.buffer.data());
+		Bus &parent = *buses[bus.parent];
+		for (uint32_t s = 0; s < 2 * block_size; ++s) {
+			parent.out[s] += bus.buffer[s];
+		}
+		parent.mixed = true;
+		std::fill(bus.buffer.begin(), bus.buffer.begin() + 2 * block_size, 0.0f); //(ready for next block)
+	}
+
+	//reverb return:
+	if (reverb && !master_bus.frozen) {
+		reverb->process(reverb_input, &buffer[0].l, start_reverb_volume, (end_reverb_volume - start_reverb_volume) / block_size);
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
-	*/
 
+	//master group:
+	if (master_bus.frozen) {
+		for (uint32_t s = 0; s < block_size; ++s) {
+			buffer[s].l = 0.0f;
+			buffer[s].r = 0.0f;
+		}
+		master_limiter.reset();
+	} else {
+		process_bus(master_bus, &buffer[0].l);
+	}
+
+	//advance the audio clock:
+	audio_frames.store(block_start + block_size, std::memory_order_release);
+
+	//statistics, for Sound::timing():
+	stats_voices_mixed.store(voices_mixed, std::memory_order_relaxed);
+	stats_voices_virtual.store(voices_virtual, std::memory_order_relaxed);
+	stats_voices_held.store(voices_held, std::memory_order_relaxed);
+	float peak = 0.0f;
+	uint32_t clipped = 0;
+	for (uint32_t s = 0; s < block_size; ++s) {
+		float level = std::max(std::abs(buffer[s].l), std::abs(buffer[s].r));
+		peak = std::max(peak, level);
+		clipped += (std::abs(buffer[s].l) > 1.0f) + (std::abs(buffer[s].r) > 1.0f);
+	}
+	float old_peak = stats_peak.load(std::memory_order_relaxed);
+	while (peak > old_peak && !stats_peak.compare_exchange_weak(old_peak, peak, std::memory_order_relaxed)) { }
+	if (clipped) stats_clipped.fetch_add(clipped, std::memory_order_relaxed);
+
+	//measure mixing time, for Sound::timing() and adaptive block size:
+	float ms = std::chrono::duration< float, std::milli >(std::chrono::steady_clock::now() - before).count();
+	float average = timing_average_ms.load(std::memory_order_relaxed);
+	timing_average_ms.store(average + 0.05f * (ms - average), std::memory_order_relaxed); //(averages over ~20 blocks)
+	float max = timing_max_ms.load(std::memory_order_relaxed);
+	while (ms > max && !timing_max_ms.compare_exchange_weak(max, ms, std::memory_order_relaxed)) { }
+	float budget_ms = 1000.0f * block_size / AUDIO_RATE;
+	uint32_t bucket = std::min(Sound::Timing::Buckets - 1, uint32_t(10.0f * ms / budget_ms));
+	timing_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+	if (blocks_since_open < WarmupBlocks) {
+		++blocks_since_open;
+	} else if (ms > budget_ms) {
+		timing_overruns.fetch_add(1, std::memory_order_relaxed);
+	}
 }
 
 
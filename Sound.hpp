@@ -2,6 +2,8 @@
 
 #include <glm/glm.hpp>
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <string>
@@ -10,19 +12,60 @@
 //Game audio system. Simplified from f18-base3.
 //Uses 48kHz sampling rate.
 
+struct OpusStream; //streaming decoder (OpusStream.hpp)
+
 namespace Sound {
 
 //Sample objects hold mono (one-channel) audio.
 struct Sample {
+	//How to load a file:
+	enum LoadMode : uint8_t {
+		Decoded, //decode the whole file into 'data' up front
+		Streamed, //('.opus' only) keep the file open and decode while playing; good for long music
+	};
+
+	//How decoded sample data is stored in memory:
+	enum Encoding : uint8_t {
+		Float32, //32-bit float, 4 bytes/sample (in 'data')
+		Int16, //16-bit PCM, 2 bytes/sample (in 'data_i16')
+		ADPCM, //IMA-ADPCM, ~0.5 bytes/sample (in 'data_adpcm'); lossy, but fine for most effects and ambience
+	};
+
 	//Load from a '.wav' or '.opus' file.
 	//  will warn and convert if sound is not already 48kHz mono:
-	Sample(std::string const &filename);
+	//  (encoding only applies to Decoded samples; streamed samples are always float)
+	Sample(std::string const &filename, LoadMode mode = Decoded, Encoding encoding = Float32);
 	
 	//Directly supply an audio buffer:
-	Sample(std::vector< float > const &data);
+	Sample(std::vector< float > const &data, Encoding encoding = Float32);
 
-	//sample data is stored as 48kHz, mono, floating-point:
+	//(moving a sample that is playing is an error -- its voices would be left pointing at the old one)
+	Sample(Sample &&);
+	~Sample();
+
+	//sample data is 48kHz, mono, stored in one of these (based on 'encoding'):
+	Encoding encoding = Float32;
 	std::vector< float > data;
+	std::vector< int16_t > data_i16;
+	std::vector< uint8_t > data_adpcm; //(blocks; see adpcm.hpp)
+	uint32_t adpcm_samples = 0; //number of samples in data_adpcm
+
+	//number of samples, whatever the encoding:
+	size_t size() const;
+	//re-encode the sample data:
+	void encode(Encoding encoding);
+
+	//...unless the sample is streamed, in which case 'data' is empty and samples come from here:
+	// (a streamed sample plays on one voice at a time; playing it again restarts it)
+	std::unique_ptr< OpusStream > stream;
+
+	//is the sample playing, or queued to play, on any voice?
+	// (a sample must outlive its playback: don't free one while this is true -- see SampleCache.hpp)
+	bool playing() const { return voices.load(std::memory_order_acquire) != 0; }
+
+	//internals:
+	//voices playing this sample (counted up by play() on the game thread, down by the mixer as each voice ends):
+	mutable std::atomic< uint32_t > voices{0};
 };
 
 //Ramp<> manages values that should be smoothly interpolated
@@ -48,81 +91,222 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+// 'PlayingSample' is a handle to a sample that is (or was) playing:
+// (the playing state itself lives in a fixed-size voice pool inside the mixer;
+//  handles are small and cheap to copy, and go stale -- harmlessly -- once playback ends)
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample;
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
-	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
+	//NOTE: these (and the global functions below) don't lock -- they queue a command
+	// that the audio callback applies at the start of the next mix block.
+	// (the queue has a single producer, so only call them from one thread -- generally the game thread)
+	void set_volume(float new_volume, float ramp = 1.0f / 60.0f) const;
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
-	void set_pan(float new_pan, float ramp = 1.0f / 60.0f);
+	void set_pan(float new_pan, float ramp = 1.0f / 60.0f) const;
 	//set the position of a sample (use only on samples in "3D" mode; no effect on "2D" samples):
-	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
+	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f) const;
 	//set the half-volume radius (use only on "3D" playing sounds):
-	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f);
+	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f) const;
+	//set the playback rate (1.0f is normal; 2.0f is twice as fast and an octave higher; clamped to [0,4]):
+	// (no effect on streamed samples, which always play at normal rate)
+	void set_rate(float new_rate, float ramp = 1.0f / 60.0f) const;
+	//turn Doppler shift on or off (use only on "3D" playing sounds):
+	// the playback rate is scaled based on how fast the sample and listener are moving toward each other,
+	// as measured from changes in their positions -- so move them smoothly (teleports will chirp).
+	void set_doppler(bool enabled) const;
+	//set how much of the sample (after volume and panning) goes to the reverb (see Sound::set_reverb), in [0,1]:
+	void set_reverb_send(float new_send, float ramp = 1.0f / 60.0f) const;
 
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
-	void stop(float ramp = 1.0f / 60.0f);
+	void stop(float ramp = 1.0f / 60.0f) const;
+	//'stop_at' cuts the sample off at exactly audio frame 'frame' (see Sound::audio_clock()):
+	// (no fade, so best where the sample is quiet -- or where the cut is the point, e.g. in time with music)
+	void stop_at(uint64_t frame) const;
+
+	//was playback stopped (either by running out of sample, by stop(), or by having its voice stolen)?
+	bool stopped() const;
+
+	//handles test and dereference like the pointers they replace, so 'if (sound) sound->set_volume(...)' works:
+	explicit operator bool() const { return slot != -1U; }
+	PlayingSample const *operator->() const { return this; }
+
+	//internals:
+	uint32_t slot = -1U; //voice slot in the mixer (-1U for a handle that refers to nothing)
+	uint32_t generation = 0; //slot generation this handle was issued for; mismatch means playback ended
+};
+
+//'Group' is a handle to a mixer group (a "bus"):
+// every playing sample belongs to a group (chosen when it starts), and each group's mix passes through
+// the group's volume, pause fade, and (optional) limiter into its parent group -- once per block, however many
+// samples are playing in it. The root of the tree, 'master' (the default-constructed Group), is the output.
+//NOTE: like PlayingSample's functions, these queue a command for the audio callback.
+struct Group {
+	//change the volume of everything in the group:
+	void set_volume(float new_volume, float ramp = 1.0f / 60.0f) const;
+	//pause (fade out over 'ramp' seconds, then hold every sample in the group and its subgroups where it is), or resume:
+	void set_paused(bool paused, float ramp = 1.0f / 60.0f) const;
+	//keep the group's output peaks below 'threshold', recovering over about 'release' seconds:
+	// (threshold <= 0 or infinity turns the limiter off)
+	// master's limiter looks ahead a short way (Limiter::Lookahead frames, about 1.3ms, delaying all output by that much)
+	// and eases into gain reduction before each peak; other groups' limiters cut in on the peak itself.
+	void set_limiter(float threshold, float release = 0.1f) const;
+
+	bool operator==(Group const &other) const { return index == other.index; }
+	bool operator!=(Group const &other) const { return index != other.index; }
 
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	uint32_t index = 0; //mixer group index (0 is master)
 };
+Group const master = Group();
 
 // ------- global functions -------
 
-void init(); //call Sound::init() from main.cpp before using any member functions
+//Mixer output format: 48kHz stereo (interleaved left/right floats), mixed in blocks of (by default) MIX_SAMPLES frames:
+constexpr uint32_t const AUDIO_RATE = 48000;
+constexpr uint32_t const MIX_SAMPLES = 1024;
+//block size limits (block sizes are powers of two in this range; see Settings::block_size):
+constexpr uint32_t const MIN_MIX_SAMPLES = 64;
+constexpr uint32_t const MAX_MIX_SAMPLES = 4096;
+
+//Mixer configuration for Sound::init():
+struct Settings {
+	//where mixed audio goes:
+	enum class Backend {
+		Device, //an SDL audio device, which calls the mixer as it needs audio
+		Null, //nowhere, until asked for -- call Sound::render() to run the mixer (for tools, tests, and benchmarks)
+	} backend = Backend::Device;
+
+	//maximum number of simultaneously playing samples (memory for these is allocated by init()):
+	uint32_t max_voices = 64;
+
+	//when all voices are busy, play() replaces (steals) one of them:
+	// (the stolen voice fades out over a few milliseconds, so it doesn't click; its handle reports stopped() right away)
+	enum class Steal {
+		Quietest, //the voice with the lowest current output gain (after its group volumes)
+		Oldest, //the voice that started playing longest ago
+	} steal = Steal::Quietest;
+
+	//voices whose gain (global volume * voice volume * pan/distance attenuation * group volumes, plus the same
+	// through their reverb send, if any) stays below this for a whole mix block may be "virtual": their playback
+	// position advances, but they aren't mixed.
+	// Leaving them out changes the output by their sum, so the virtual voices in a block share this as a budget:
+	// their gains add up to less than audible_gain, so the output differs from mixing everything by less than
+	// audible_gain (times full scale), however many quiet voices are playing -- once the budget is spent, the rest are mixed.
+	// (1/4096 is about -72dB; set to 0 to mix every voice)
+	float audible_gain = 1.0f / 4096.0f;
+
+	//threshold of master's limiter (see Group::set_limiter), which keeps the output from clipping
+	// however many samples are playing at once; set to 0 to turn it off:
+	float master_limiter = 1.0f;
+
+	//speed of sound for Doppler shift (see PlayingSample::set_doppler), in world units per second:
+	float speed_of_sound = 343.0f;
+
+	//frames mixed per block (i.e., per audio callback); smaller blocks mean lower latency, but less time to mix each one:
+	// (rounded up to a power of two in [MIN_MIX_SAMPLES, MAX_MIX_SAMPLES])
+	uint32_t block_size = MIX_SAMPLES;
+
+	//start at 'block_size' and double it (from Sound::update()) whenever mixing keeps overrunning its budget:
+	// (e.g., block_size = 256 with adaptive_block_size gets low latency on machines that can keep up)
+	bool adaptive_block_size = false;
+};
+
+void init(Settings const &settings = Settings()); //call Sound::init() from main.cpp before using any member functions
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
+//Run the mixer directly to produce the next 'frames' frames of audio (2 * frames floats) in 'out':
+// (only when no audio device is open -- i.e., with the Null backend, or if opening the device failed;
+//  queued commands are applied at block boundaries, just as they would be by the device callback)
+void render(float *out, uint32_t frames);
+
+//Call Sound::update() once per frame (from main.cpp) to handle adaptive block size changes:
+void update();
+
+//Change the block size (rounded as for Settings::block_size); reopens the audio device, so there will be a small gap in output:
+// (call from the same thread as the other functions here -- generally the game thread)
+void set_block_size(uint32_t block_size);
+
+//Mixer timing and statistics, for tuning block size and keeping an eye on the mix:
+// (gathered by the audio callback without locking; reading them never takes the audio lock either)
+struct Timing {
+	uint32_t block_size = 0; //current frames per block
+	float budget_ms = 0.0f; //time one block of audio lasts -- mixing must take less than this
+	float average_ms = 0.0f; //time taken to mix a block (recent average)
+	float max_ms = 0.0f; //longest time to mix a block since the last call to timing()
+	uint32_t overruns = 0; //blocks that took longer than 'budget_ms' to mix (ever)
+	uint32_t late = 0; //callbacks that came more than two blocks after the previous one -- the device likely ran dry (ever)
+
+	//blocks mixed since the last call to timing(), by time taken:
+	// (histogram[b] counts blocks that took [b/10, (b+1)/10) of the budget; the last bucket is everything over budget)
+	static constexpr uint32_t const Buckets = 11;
+	uint32_t histogram[Buckets] = {};
+
+	//voices in the most recent block:
+	uint32_t voices_mixed = 0; //mixed into the output
+	uint32_t voices_virtual = 0; //too quiet to hear, so advanced without mixing
+	uint32_t voices_held = 0; //in a paused group, or scheduled to start later
+	uint32_t voices_stopped = 0; //voices that have finished, been stopped, or been stolen (ever)
+
+	//output level:
+	float peak = 0.0f; //largest output sample magnitude since the last call to timing()
+	uint32_t clipped = 0; //output samples outside [-1,1] (ever)
+};
+Timing timing();
+
+//Create a mixer group feeding into 'parent':
+// (groups last until Sound::shutdown(); there can be at most 32, including master -- if out, returns 'parent')
+Group add_group(Group parent = master, float volume = 1.0f);
+
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
-std::shared_ptr< PlayingSample > play(
+//  (the sample must outlive its playback; if no voice slot is free, returns a null handle)
+PlayingSample play(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	Group group = master
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > play_3D(
+PlayingSample play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Group group = master
 );
 
 //Call 'Sound::loop' to play a sample ~forever~.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback.
-std::shared_ptr< PlayingSample > loop(
+PlayingSample loop(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	Group group = master
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > loop_3D(
+PlayingSample loop_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Group group = master
 );
 
+//Audio clock: the number of frames the mixer has mixed so far.
+// (advances a block at a time; the mixer runs ahead of what is heard by about a block plus the device's latency)
+uint64_t audio_clock();
+
+//The '_at' versions of the functions above start playback at exactly audio frame 'frame' (see audio_clock()),
+// for sounds that must line up with each other (or with music):
+//  (frames already mixed can't be played at; those samples start as soon as possible -- so schedule a block or two ahead)
+PlayingSample play_at(Sample const &sample, uint64_t frame, float volume = 1.0f, float pan = 0.0f, Group group = master);
+PlayingSample play_3D_at(Sample const &sample, uint64_t frame, float volume, glm::vec3 const &position,
+	float half_volume_radius = std::numeric_limits< float >::infinity(), Group group = master);
+PlayingSample loop_at(Sample const &sample, uint64_t frame, float volume = 1.0f, float pan = 0.0f, Group group = master);
+PlayingSample loop_3D_at(Sample const &sample, uint64_t frame, float volume, glm::vec3 const &position,
+	float half_volume_radius = std::numeric_limits< float >::infinity(), Group group = master);
+
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
 struct Listener {
 	void set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
@@ -133,6 +317,21 @@ struct Listener {
 };
 extern struct Listener listener;
 
+//Reverb: playing samples send some of their output (see PlayingSample::set_reverb_send) to a
+// convolution reverb, whose output is mixed back in at 'reverb_volume'.
+// (a send is scaled by the volumes of the sample's group and its parents; the reverb's output mixes into master,
+//  so master's volume, pause fade, and limiter apply to it once, on the way out)
+//set the reverb's impulse response (stereo output comes from the sends' panning):
+// (the filter is built on the calling thread -- a little slow for long impulse responses --
+//  and takes effect at the next mix block; per-block cost grows with impulse response length, see reverb-bench)
+void set_reverb(Sample const &impulse_response);
+//remove the reverb (sends are then ignored):
+void clear_reverb();
+
+//set reverb return volume:
+void set_reverb_volume(float new_volume, float ramp = 1.0f / 60.0f);
+extern Ramp< float > reverb_volume;
+
 //"panic button" to shut off all currently playing sounds:
 void stop_all_samples();
 
@@ -141,8 +340,8 @@ void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
+// the set_*/stop/play/... functions queue commands instead of locking, so you shouldn't need
+// to call these unless your code is modifying many values directly (a rare bulk operation):
 void lock();
 void unlock();
 
@@ -0,0 +1,149 @@
+#include "TransformArray.hpp"
+
+#include <cassert>
+#include <stdexcept>
+#include <type_traits>
+
+//same as Scene::Transform::make_local_to_parent():
+static glm::mat4x3 make_local_to_parent(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
+	glm::mat3 rot = glm::mat3_cast(rotation);
+	return glm::mat4x3(
+		rot[0] * scale.x, //scaling the columns here means that scale happens before rotation
+		rot[1] * scale.y,
+		rot[2] * scale.z,
+		position
+	);
+}
+
+TransformArray::Handle TransformArray::add(std::string const &name, Handle parent,
+	glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
+
+	Handle handle;
+	handle.value = uint32_t(index_of_handle.size());
+
+	//appending keeps the arrays sorted, since the parent already exists:
+	uint32_t idx = uint32_t(positions.size());
+	positions.emplace_back(position);
+	rotations.emplace_back(rotation);
+	scales.emplace_back(scale);
+	parents.emplace_back(parent ? index(parent) : -1U);
+	names.emplace_back(name);
+	local_to_world.emplace_back(1.0f);
+
+	index_of_handle.emplace_back(idx);
+	handle_of_index.emplace_back(handle.value);
+
+	return handle;
+}
+
+void TransformArray::set_parent(Handle transform, Handle parent) {
+	uint32_t idx = index(transform);
+	uint32_t parent_idx = (parent ? index(parent) : -1U);
+
+	//check for cycles:
+	for (uint32_t p = parent_idx; p != -1U; p = parents[p]) {
+		if (p == idx) throw std::runtime_error("Parenting '" + names[idx] + "' to '" + names[parent_idx] + "' would make a cycle.");
+	}
+
+	parents[idx] = parent_idx;
+	if (parent_idx != -1U && parent_idx > idx) sort();
+}
+
+TransformArray::Handle TransformArray::find(std::string const &name) const {
+	Handle ret;
+	for (uint32_t i = 0; i < names.size(); ++i) {
+		if (names[i] == name) {
+			ret.value = handle_of_index[i];
+			break;
+		}
+	}
+	return ret;
+}
+
+void TransformArray::update() {
+	assert(local_to_world.size() == positions.size());
+	for (uint32_t i = 0; i < positions.size(); ++i) {
+		glm::mat4x3 local_to_parent = make_local_to_parent(positions[i], rotations[i], scales[i]);
+		if (parents[i] == -1U) {
+			local_to_world[i] = local_to_parent;
+		} else {
+			assert(parents[i] < i);
+			local_to_world[i] = local_to_world[parents[i]] * glm::mat4(local_to_parent); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+	}
+}
+
+void TransformArray::set(Scene const &scene, std::unordered_map< Scene::Transform const *, Handle > *handle_map_) {
+	std::unordered_map< Scene::Transform const *, Handle > temp;
+	std::unordered_map< Scene::Transform const *, Handle > &handle_map = *(handle_map_ ? handle_map_ : &temp);
+	handle_map.clear();
+
+	*this = TransformArray();
+
+	//add in list order, fixing up parents afterward (list order isn't necessarily sorted):
+	for (auto const &t : scene.transforms) {
+		handle_map.emplace(&t, add(t.name, Handle(), t.position, t.rotation, t.scale));
+	}
+	bool sorted = true;
+	for (auto const &t : scene.transforms) {
+		if (!t.parent) continue;
+		auto f = handle_map.find(t.parent);
+		if (f == handle_map.end()) throw std::runtime_error("Transform '" + t.name + "' has a parent outside its scene.");
+		uint32_t idx = index(handle_map.at(&t));
+		parents[idx] = index(f->second);
+		if (parents[idx] > idx) sorted = false;
+	}
+	if (!sorted) sort();
+}
+
+void TransformArray::sort() {
+	uint32_t count = uint32_t(positions.size());
+
+	//children lists, in index order:
+	std::vector< uint32_t > first_child(count, -1U);
+	std::vector< uint32_t > next_sibling(count, -1U);
+	for (uint32_t i = count - 1; i < count; --i) {
+		if (parents[i] == -1U) continue;
+		next_sibling[i] = first_child[parents[i]];
+		first_child[parents[i]] = i;
+	}
+
+	//breadth-first from the roots gives parents-before-children order:
+	std::vector< uint32_t > order;
+	order.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		if (parents[i] == -1U) order.emplace_back(i);
+	}
+	for (uint32_t o = 0; o < order.size(); ++o) {
+		for (uint32_t c = first_child[order[o]]; c != -1U; c = next_sibling[c]) {
+			order.emplace_back(c);
+		}
+	}
+	if (order.size() != count) throw std::runtime_error("TransformArray hierarchy contains a cycle.");
+
+	std::vector< uint32_t > new_index(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		new_index[order[i]] = i;
+	}
+
+	auto permute = [&](auto &array) {
+		typename std::remove_reference< decltype(array) >::type sorted;
+		sorted.reserve(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			sorted.emplace_back(std::move(array[order[i]]));
+		}
+		array = std::move(sorted);
+	};
+	permute(positions);
+	permute(rotations);
+	permute(scales);
+	permute(parents);
+	permute(names);
+	permute(local_to_world);
+	permute(handle_of_index);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		if (parents[i] != -1U) parents[i] = new_index[parents[i]];
+		index_of_handle[handle_of_index[i]] = i;
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+/*
+ * TransformArray is a packed alternative to Scene's std::list< Scene::Transform >.
+ *
+ * Transforms are stored as parallel arrays (positions, rotations, scales, parent indices),
+ * kept in topologically sorted order (every parent comes before its children).
+ * This makes:
+ *  - a full hierarchy update one forward pass over contiguous arrays (see update()),
+ *  - copying a whole hierarchy a handful of vector copies (no pointer fix-up).
+ *
+ * Because re-parenting may re-sort the arrays, transforms are referred to by Handle,
+ * which stays valid across re-sorting and copying (a Handle from one array refers to
+ * the same transform in any copy of that array).
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TransformArray {
+	struct Handle {
+		Handle() : value(-1U) { }
+		uint32_t value;
+		explicit operator bool() const { return value != -1U; }
+		bool operator==(Handle const &o) const { return value == o.value; }
+		bool operator!=(Handle const &o) const { return value != o.value; }
+	};
+
+	//add a transform (parent may be a null Handle for a root):
+	Handle add(std::string const &name, Handle parent = Handle(),
+		glm::vec3 const &position = glm::vec3(0.0f),
+		glm::quat const &rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+		glm::vec3 const &scale = glm::vec3(1.0f));
+
+	//change a transform's parent (throws if this would make a cycle):
+	// note: re-sorts the arrays, so indices (but not handles) may change.
+	void set_parent(Handle transform, Handle parent);
+
+	//look up position in the arrays:
+	uint32_t index(Handle handle) const { return index_of_handle[handle.value]; }
+	//find first transform with a given name (null Handle if none):
+	Handle find(std::string const &name) const;
+
+	size_t size() const { return positions.size(); }
+
+	//fill 'local_to_world' for every transform (one pass, parents first):
+	void update();
+
+	//build from a scene's transforms (optionally returning the transform->handle mapping):
+	void set(Scene const &scene, std::unordered_map< Scene::Transform const *, Handle > *handle_map = nullptr);
+
+	//the arrays themselves, indexed by 'index(handle)':
+	std::vector< glm::vec3 > positions;
+	std::vector< glm::quat > rotations;
+	std::vector< glm::vec3 > scales;
+	std::vector< uint32_t > parents; //index of parent (always less than own index), or -1U for roots
+	std::vector< std::string > names;
+
+	std::vector< glm::mat4x3 > local_to_world; //computed by update()
+
+	//--- internals ---
+	std::vector< uint32_t > index_of_handle; //handle -> index
+	std::vector< uint32_t > handle_of_index; //index -> handle
+
+	//re-order arrays so that parents precede children:
+	void sort();
+};
@@ -0,0 +1,122 @@
+#include "adpcm.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+//standard IMA-ADPCM tables:
+static int32_t const step_table[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static int32_t const index_table[16] = {
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+//apply one 4-bit code to the decoder state:
+// (the encoder calls this too, so both sides track exactly the same predictor)
+static inline void step(uint32_t code, int32_t *predictor, int32_t *step_index) {
+	int32_t s = step_table[*step_index];
+	int32_t diff = s >> 3;
+	if (code & 4) diff += s;
+	if (code & 2) diff += s >> 1;
+	if (code & 1) diff += s >> 2;
+	if (code & 8) diff = -diff;
+	*predictor = std::max(-32768, std::min(32767, *predictor + diff));
+	*step_index = std::max(0, std::min(88, *step_index + index_table[code]));
+}
+
+static inline int32_t to_int16(float sample) {
+	return int32_t(std::max(-32768.0f, std::min(32767.0f, std::round(sample * 32768.0f))));
+}
+
+void adpcm_encode(float const *samples, uint32_t count, std::vector< uint8_t > *blocks_) {
+	assert(blocks_);
+	auto &blocks = *blocks_;
+
+	uint32_t block_count = (count + ADPCM_BLOCK_SAMPLES - 1) / ADPCM_BLOCK_SAMPLES;
+	blocks.assign(size_t(block_count) * ADPCM_BLOCK_BYTES, 0);
+
+	int32_t step_index = 0;
+	for (uint32_t b = 0; b < block_count; ++b) {
+		uint8_t *block = blocks.data() + size_t(b) * ADPCM_BLOCK_BYTES;
+		uint32_t first = b * ADPCM_BLOCK_SAMPLES;
+		uint32_t last = std::min(count, first + ADPCM_BLOCK_SAMPLES);
+
+		//header (step index carries over from the previous block, so it's already adapted to the signal):
+		int32_t predictor = to_int16(samples[first]);
+		block[0] = uint8_t(predictor & 0xff);
+		block[1] = uint8_t((predictor >> 8) & 0xff);
+		block[2] = uint8_t(step_index);
+
+		for (uint32_t i = first + 1; i < last; ++i) {
+			//pick the code whose reconstruction is closest to the sample:
+			int32_t s = step_table[step_index];
+			int32_t diff = to_int16(samples[i]) - predictor;
+			uint32_t code = 0;
+			if (diff < 0) {
+				code = 8;
+				diff = -diff;
+			}
+			if (diff >= s) { code |= 4; diff -= s; }
+			s >>= 1;
+			if (diff >= s) { code |= 2; diff -= s; }
+			s >>= 1;
+			if (diff >= s) { code |= 1; }
+
+			step(code, &predictor, &step_index);
+
+			uint32_t n = i - first - 1;
+			block[4 + n / 2] |= uint8_t(code << (4 * (n & 1)));
+		}
+	}
+}
+
+void adpcm_decode(uint8_t const *blocks, uint32_t begin, uint32_t count, float *out, AdpcmCursor *cursor) {
+	assert(cursor);
+	constexpr float const Scale = 1.0f / 32768.0f;
+	if (count == 0) return;
+
+	//if not continuing from where the cursor left off, start over from the block header:
+	// (decoding, but not writing, any samples before 'begin')
+	if (cursor->next != begin) {
+		cursor->next = begin - begin % ADPCM_BLOCK_SAMPLES;
+	}
+
+	uint32_t i = cursor->next;
+	int32_t predictor = cursor->predictor;
+	int32_t step_index = cursor->step_index;
+	uint32_t const end = begin + count;
+	while (i < end) {
+		uint8_t const *block = blocks + size_t(i / ADPCM_BLOCK_SAMPLES) * ADPCM_BLOCK_BYTES;
+		uint32_t in_block = i % ADPCM_BLOCK_SAMPLES;
+		if (in_block == 0) {
+			predictor = int16_t(uint16_t(block[0]) | (uint16_t(block[1]) << 8));
+			step_index = std::min< int32_t >(88, block[2]);
+			if (i >= begin) out[i - begin] = float(predictor) * Scale;
+			++i;
+			++in_block;
+		}
+		//codes for the rest of this block (or up to 'end'):
+		uint32_t block_end = std::min(end, i - in_block + ADPCM_BLOCK_SAMPLES);
+		for (; i < block_end; ++i, ++in_block) {
+			uint32_t n = in_block - 1;
+			uint32_t code = (block[4 + n / 2] >> (4 * (n & 1))) & 0xf;
+			step(code, &predictor, &step_index);
+			if (i >= begin) out[i - begin] = float(predictor) * Scale;
+		}
+	}
+
+	cursor->next = end;
+	cursor->predictor = predictor;
+	cursor->step_index = step_index;
+}
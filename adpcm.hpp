@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+ * IMA-ADPCM encoding for in-memory mono samples.
+ *
+ * Samples are stored in independent blocks of ADPCM_BLOCK_BYTES bytes, each holding
+ * ADPCM_BLOCK_SAMPLES samples (the same layout as a mono block in an IMA-ADPCM '.wav'):
+ *  - bytes 0-1: first sample, as little-endian int16 (also the initial predictor)
+ *  - byte 2: initial step index
+ *  - byte 3: (unused, zero)
+ *  - remaining bytes: 4-bit codes for the other samples, low nibble first
+ *
+ * Since blocks are independent, decoding can start at any block; an AdpcmCursor
+ * remembers where the last decode stopped, so sequential playback never re-decodes.
+ *
+ */
+
+#include <cstdint>
+#include <vector>
+
+constexpr uint32_t const ADPCM_BLOCK_BYTES = 256;
+constexpr uint32_t const ADPCM_BLOCK_SAMPLES = 1 + 2 * (ADPCM_BLOCK_BYTES - 4); //505
+
+//encode 'count' samples (in [-1,1]; clamped) as ADPCM blocks, replacing the contents of 'blocks':
+// (the last block is padded with silence)
+void adpcm_encode(float const *samples, uint32_t count, std::vector< uint8_t > *blocks);
+
+//decoder state:
+struct AdpcmCursor {
+	uint32_t next = -1U; //index of the sample the state below will decode next (-1U: none)
+	int32_t predictor = 0; //value of sample next-1
+	int32_t step_index = 0;
+};
+
+//decode samples [begin, begin+count) from 'blocks' as floats into 'out':
+// continues from 'cursor' if it is at 'begin', otherwise starts from the enclosing block's header.
+void adpcm_decode(uint8_t const *blocks, uint32_t begin, uint32_t count, float *out, AdpcmCursor *cursor);
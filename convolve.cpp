@@ -0,0 +1,181 @@
+#include "convolve.hpp"
+
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+constexpr double const Pi = 3.14159265358979323846;
+
+//---------------- spectrum multiply-add kernels ----------------
+//(a += x * h, for complex values stored as separate real/imaginary arrays; n is always a multiple of 8)
+
+static void cmac_scalar(float const *x_re, float const *x_im, float const *h_re, float const *h_im, float *a_re, float *a_im, uint32_t n) {
+	for (uint32_t i = 0; i < n; ++i) {
+		a_re[i] += x_re[i] * h_re[i] - x_im[i] * h_im[i];
+		a_im[i] += x_re[i] * h_im[i] + x_im[i] * h_re[i];
+	}
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2")
+static void cmac_sse2(float const *x_re, float const *x_im, float const *h_re, float const *h_im, float *a_re, float *a_im, uint32_t n) {
+	for (uint32_t i = 0; i < n; i += 4) {
+		__m128 xr = _mm_loadu_ps(x_re + i);
+		__m128 xi = _mm_loadu_ps(x_im + i);
+		__m128 hr = _mm_loadu_ps(h_re + i);
+		__m128 hi = _mm_loadu_ps(h_im + i);
+		_mm_storeu_ps(a_re + i, _mm_add_ps(_mm_loadu_ps(a_re + i), _mm_sub_ps(_mm_mul_ps(xr, hr), _mm_mul_ps(xi, hi))));
+		_mm_storeu_ps(a_im + i, _mm_add_ps(_mm_loadu_ps(a_im + i), _mm_add_ps(_mm_mul_ps(xr, hi), _mm_mul_ps(xi, hr))));
+	}
+}
+
+SIMD_TARGET("avx2")
+static void cmac_avx2(float const *x_re, float const *x_im, float const *h_re, float const *h_im, float *a_re, float *a_im, uint32_t n) {
+	for (uint32_t i = 0; i < n; i += 8) {
+		__m256 xr = _mm256_loadu_ps(x_re + i);
+		__m256 xi = _mm256_loadu_ps(x_im + i);
+		__m256 hr = _mm256_loadu_ps(h_re + i);
+		__m256 hi = _mm256_loadu_ps(h_im + i);
+		_mm256_storeu_ps(a_re + i, _mm256_add_ps(_mm256_loadu_ps(a_re + i), _mm256_sub_ps(_mm256_mul_ps(xr, hr), _mm256_mul_ps(xi, hi))));
+		_mm256_storeu_ps(a_im + i, _mm256_add_ps(_mm256_loadu_ps(a_im + i), _mm256_add_ps(_mm256_mul_ps(xr, hi), _mm256_mul_ps(xi, hr))));
+	}
+}
+
+static void (* const cmac)(float const *, float const *, float const *, float const *, float *, float *, uint32_t) =
+	simd_select(cmac_scalar, cmac_sse2, cmac_avx2);
+
+#else
+
+static void (* const cmac)(float const *, float const *, float const *, float const *, float *, float *, uint32_t) = cmac_scalar;
+
+#endif //SIMD_X86
+
+//---------------- setup ----------------
+
+Convolver::Convolver(float const *impulse_response, size_t length, uint32_t block_) : block(block_), size(2 * block_) {
+	assert(block >= 4 && (block & (block - 1)) == 0);
+
+	//FFT tables:
+	uint32_t bits = 0;
+	while ((1U << bits) < size) ++bits;
+	bit_reverse.resize(size);
+	for (uint32_t i = 0; i < size; ++i) {
+		uint32_t r = 0;
+		for (uint32_t b = 0; b < bits; ++b) {
+			if (i & (1U << b)) r |= 1U << (bits - 1 - b);
+		}
+		bit_reverse[i] = r;
+	}
+	twiddle_re.resize(size / 2);
+	twiddle_im.resize(size / 2);
+	for (uint32_t k = 0; k < size / 2; ++k) {
+		double angle = -2.0 * Pi * double(k) / double(size);
+		twiddle_re[k] = float(std::cos(angle));
+		twiddle_im[k] = float(std::sin(angle));
+	}
+
+	//transform each block of the impulse response, zero-padded to the FFT size:
+	partitions = uint32_t((length + block - 1) / block);
+	filter_re.assign(size_t(partitions) * size, 0.0f);
+	filter_im.assign(size_t(partitions) * size, 0.0f);
+	for (uint32_t p = 0; p < partitions; ++p) {
+		float *re = &filter_re[size_t(p) * size];
+		float *im = &filter_im[size_t(p) * size];
+		size_t begin = size_t(p) * block;
+		size_t count = std::min< size_t >(block, length - begin);
+		for (size_t i = 0; i < count; ++i) {
+			re[i] = impulse_response[begin + i] / float(size); //(scaled here, so the inverse FFT comes out right)
+		}
+		fft(re, im);
+	}
+
+	history_re.assign(size_t(partitions) * size, 0.0f);
+	history_im.assign(size_t(partitions) * size, 0.0f);
+	last_re.assign(block, 0.0f);
+	last_im.assign(block, 0.0f);
+	output_re.assign(size, 0.0f);
+	output_im.assign(size, 0.0f);
+
+	//no input yet, so the output starts silent:
+	silent_blocks = partitions + 1;
+}
+
+//---------------- processing ----------------
+
+void Convolver::fft(float *re, float *im) const {
+	for (uint32_t i = 0; i < size; ++i) {
+		uint32_t r = bit_reverse[i];
+		if (r > i) {
+			std::swap(re[i], re[r]);
+			std::swap(im[i], im[r]);
+		}
+	}
+	//radix-2 butterflies, combining transforms of length 'half' into transforms of length 2*half:
+	for (uint32_t half = 1; half < size; half *= 2) {
+		uint32_t const stride = size / (2 * half); //twiddle index step
+		for (uint32_t i = 0; i < size; i += 2 * half) {
+			for (uint32_t j = 0; j < half; ++j) {
+				float w_re = twiddle_re[j * stride];
+				float w_im = twiddle_im[j * stride];
+				uint32_t a = i + j;
+				uint32_t b = a + half;
+				float t_re = re[b] * w_re - im[b] * w_im;
+				float t_im = re[b] * w_im + im[b] * w_re;
+				re[b] = re[a] - t_re;
+				im[b] = im[a] - t_im;
+				re[a] += t_re;
+				im[a] += t_im;
+			}
+		}
+	}
+}
+
+void Convolver::process(float const *in, float *out, float gain, float gain_step) {
+	if (partitions == 0) return;
+
+	bool silent = true;
+	for (uint32_t s = 0; s < 2 * block; ++s) {
+		if (in[s] != 0.0f) {
+			silent = false;
+			break;
+		}
+	}
+	if (silent) {
+		if (silent_blocks > partitions) return; //(every stored spectrum is zero already)
+		++silent_blocks;
+	} else {
+		silent_blocks = 0;
+	}
+
+	//transform the window [last block, this block] into the next history slot:
+	newest = (newest + 1) % partitions;
+	float *x_re = &history_re[size_t(newest) * size];
+	float *x_im = &history_im[size_t(newest) * size];
+	std::copy(last_re.begin(), last_re.end(), x_re);
+	std::copy(last_im.begin(), last_im.end(), x_im);
+	for (uint32_t s = 0; s < block; ++s) {
+		x_re[block + s] = last_re[s] = in[2 * s + 0];
+		x_im[block + s] = last_im[s] = in[2 * s + 1];
+	}
+	fft(x_re, x_im);
+
+	//the window from p blocks ago meets partition p of the impulse response:
+	std::fill(output_re.begin(), output_re.end(), 0.0f);
+	std::fill(output_im.begin(), output_im.end(), 0.0f);
+	for (uint32_t p = 0; p < partitions; ++p) {
+		size_t h = size_t((newest + partitions - p) % partitions) * size;
+		size_t f = size_t(p) * size;
+		cmac(&history_re[h], &history_im[h], &filter_re[f], &filter_im[f], output_re.data(), output_im.data(), size);
+	}
+
+	//inverse transform (by swapping real and imaginary parts); the second half of the window is this block's output:
+	fft(output_im.data(), output_re.data());
+	for (uint32_t s = 0; s < block; ++s) {
+		out[2 * s + 0] += gain * output_re[block + s];
+		out[2 * s + 1] += gain * output_im[block + s];
+		gain += gain_step;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+ * Convolver applies a (long) mono impulse response -- e.g., a reverb -- to a stereo signal, one fixed-size block at a time:
+ *
+ * Convolver reverb(ir.data(), ir.size(), 1024);
+ * //every block: convolve 1024 interleaved stereo frames from 'in', adding the result (times 'gain') to 'out':
+ * reverb.process(in, out, gain, 0.0f);
+ *
+ * It uses uniformly-partitioned FFT convolution (overlap-save): the impulse response is cut into block-sized
+ * partitions, each transformed once up front. Every block then costs one forward and one inverse FFT
+ * (of size 2*block), plus one spectrum multiply-add per partition -- a fixed cost per block that grows linearly
+ * with impulse response length. The output has no added latency.
+ *
+ * Left and right are convolved together, as the real and imaginary parts of one complex signal.
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Convolver {
+	//'block' must be a power of two:
+	Convolver(float const *impulse_response, size_t length, uint32_t block);
+
+	//convolve the next 'block' stereo frames (interleaved) of 'in', adding the result to 'out' with a
+	// gain that starts at 'gain' and increases by 'gain_step' every frame:
+	void process(float const *in, float *out, float gain, float gain_step);
+
+	//--- internals ---
+	uint32_t block = 0; //frames per process() call
+	uint32_t size = 0; //FFT size (2 * block)
+	uint32_t partitions = 0; //impulse response length, in blocks
+
+	//FFT tables:
+	std::vector< uint32_t > bit_reverse; //size
+	std::vector< float > twiddle_re, twiddle_im; //size/2; exp(-2 pi i k / size)
+
+	//spectra are stored as separate real and imaginary arrays of 'size' floats, one after the other:
+	std::vector< float > filter_re, filter_im; //impulse response partition spectra (scaled by 1/size, for the inverse FFT)
+	std::vector< float > history_re, history_im; //spectra of the last 'partitions' input windows, a ring...
+	uint32_t newest = 0; //...whose most recent entry is this one
+
+	std::vector< float > last_re, last_im; //previous input block (left, right)
+
+	//scratch for accumulating the current block's output spectrum:
+	std::vector< float > output_re, output_im;
+
+	//input blocks in a row that were silent; after more than 'partitions' of them, the output is silent too, so skip the work:
+	uint32_t silent_blocks = 0;
+
+	//in-place FFT of 'size' values (without scaling; swap the arrays for an inverse FFT):
+	void fft(float *re, float *im) const;
+};
@@ -0,0 +1,154 @@
+#include "limiter.hpp"
+
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+//---------------- kernels ----------------
+//'required_gains' computes, for each of 'frames' interleaved stereo frames, the gain that brings its peak to 'threshold' (at most 1);
+//'window_min' replaces each of values [0, count - width) with the smaller of it and the value 'width' later.
+
+static void required_gains_scalar(float const *data, uint32_t frames, float threshold, float *out) {
+	for (uint32_t i = 0; i < frames; ++i) {
+		float peak = std::max(std::abs(data[2 * i + 0]), std::abs(data[2 * i + 1]));
+		out[i] = std::min(1.0f, threshold / peak); //(silence divides to infinity, so gets 1)
+	}
+}
+
+static void window_min_scalar(float *values, uint32_t count, uint32_t width) {
+	for (uint32_t i = 0; i + width < count; ++i) {
+		values[i] = std::min(values[i], values[i + width]);
+	}
+}
+
+#ifdef SIMD_X86
+
+//four frames / values per iteration:
+
+SIMD_TARGET("sse2")
+static void required_gains_sse2(float const *data, uint32_t frames, float threshold, float *out) {
+	__m128 const abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const limit = _mm_set1_ps(threshold);
+	uint32_t i = 0;
+	for (; i + 4 <= frames; i += 4) {
+		__m128 a = _mm_and_ps(_mm_loadu_ps(data + 2 * i), abs_mask); //l0 r0 l1 r1
+		__m128 b = _mm_and_ps(_mm_loadu_ps(data + 2 * i + 4), abs_mask); //l2 r2 l3 r3
+		__m128 peak = _mm_max_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+		_mm_storeu_ps(out + i, _mm_min_ps(_mm_div_ps(limit, peak), one));
+	}
+	required_gains_scalar(data + 2 * i, frames - i, threshold, out + i);
+}
+
+SIMD_TARGET("sse2")
+static void window_min_sse2(float *values, uint32_t count, uint32_t width) {
+	//(each iteration loads values[i + width ...] before storing values[i ...], and later iterations only read further on,
+	// so updating in place is safe even when width < 4)
+	uint32_t i = 0;
+	for (; i + width + 4 <= count; i += 4) {
+		_mm_storeu_ps(values + i, _mm_min_ps(_mm_loadu_ps(values + i), _mm_loadu_ps(values + i + width)));
+	}
+	for (; i + width < count; ++i) {
+		values[i] = std::min(values[i], values[i + width]);
+	}
+}
+
+//eight frames / values per iteration:
+
+SIMD_TARGET("avx2")
+static void required_gains_avx2(float const *data, uint32_t frames, float threshold, float *out) {
+	__m256 const abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 const one = _mm256_set1_ps(1.0f);
+	__m256 const limit = _mm256_set1_ps(threshold);
+	uint32_t i = 0;
+	for (; i + 8 <= frames; i += 8) {
+		__m256 a = _mm256_and_ps(_mm256_loadu_ps(data + 2 * i), abs_mask); //l0 r0 l1 r1 | l2 r2 l3 r3
+		__m256 b = _mm256_and_ps(_mm256_loadu_ps(data + 2 * i + 8), abs_mask); //l4 r4 l5 r5 | l6 r6 l7 r7
+		//shuffle works within 128-bit lanes, giving frames 0 1 4 5 | 2 3 6 7; permute back into order:
+		__m256 peak = _mm256_max_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)), _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+		peak = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(peak), _MM_SHUFFLE(3,1,2,0)));
+		_mm256_storeu_ps(out + i, _mm256_min_ps(_mm256_div_ps(limit, peak), one));
+	}
+	required_gains_scalar(data + 2 * i, frames - i, threshold, out + i);
+}
+
+SIMD_TARGET("avx2")
+static void window_min_avx2(float *values, uint32_t count, uint32_t width) {
+	//(in-place update is safe for the same reason as in window_min_sse2)
+	uint32_t i = 0;
+	for (; i + width + 8 <= count; i += 8) {
+		_mm256_storeu_ps(values + i, _mm256_min_ps(_mm256_loadu_ps(values + i), _mm256_loadu_ps(values + i + width)));
+	}
+	for (; i + width < count; ++i) {
+		values[i] = std::min(values[i], values[i + width]);
+	}
+}
+
+static void (* const required_gains)(float const *, uint32_t, float, float *) =
+	simd_select(required_gains_scalar, required_gains_sse2, required_gains_avx2);
+static void (* const window_min)(float *, uint32_t, uint32_t) =
+	simd_select(window_min_scalar, window_min_sse2, window_min_avx2);
+
+#else
+
+static void (* const required_gains)(float const *, uint32_t, float, float *) = required_gains_scalar;
+static void (* const window_min)(float *, uint32_t, uint32_t) = window_min_scalar;
+
+#endif //SIMD_X86
+
+//---------------- Limiter ----------------
+
+Limiter::Limiter(uint32_t max_frames) :
+	required(Window + max_frames), gain(Window + max_frames), delayed(2 * (Lookahead + max_frames)), recent(Window) {
+	reset();
+}
+
+void Limiter::reset() {
+	std::fill(required.begin(), required.end(), 1.0f);
+	std::fill(delayed.begin(), delayed.end(), 0.0f);
+	envelope = 1.0f;
+	std::fill(recent.begin(), recent.end(), 1.0f);
+	recent_next = 0;
+}
+
+void Limiter::process(float *data, uint32_t frames, float threshold, float release) {
+	assert(frames >= Lookahead && Window + frames <= required.size());
+
+	//gain each new frame needs, after the last Window frames of the previous block:
+	required_gains(data, frames, threshold, required.data() + Window);
+
+	//held minimum over the window: after passes with widths 1, 2, 4, ..., Window/2, gain[i] is the minimum of required[i, i + Window):
+	uint32_t const count = Window + frames;
+	std::copy(required.begin(), required.begin() + count, gain.begin());
+	for (uint32_t width = 1; width < Window; width *= 2) {
+		window_min(gain.data(), count, width);
+	}
+	std::copy(required.begin() + frames, required.begin() + count, required.begin()); //(keep the window for next block)
+
+	//release, then average over the window -- frame n's held minimum, covering frames [n - Window + 1, n], is gain[n + 1]:
+	float sum = 0.0f;
+	for (float e : recent) sum += e; //(summed fresh each block, so rounding doesn't accumulate)
+	for (uint32_t n = 0; n < frames; ++n) {
+		float held = gain[n + 1];
+		if (held < envelope) {
+			envelope = held;
+		} else {
+			envelope += (held - envelope) * release;
+		}
+		sum += envelope - recent[recent_next];
+		recent[recent_next] = envelope;
+		recent_next = (recent_next + 1) % Window;
+		gain[n] = sum * (1.0f / Window);
+	}
+
+	//apply to the input from Lookahead frames ago:
+	// (the clamp only catches rounding in the average above -- a few parts in 10^7 -- so the threshold is a hard ceiling)
+	std::copy(data, data + 2 * frames, delayed.begin() + 2 * Lookahead);
+	for (uint32_t n = 0; n < frames; ++n) {
+		data[2 * n + 0] = std::max(-threshold, std::min(threshold, delayed[2 * n + 0] * gain[n]));
+		data[2 * n + 1] = std::max(-threshold, std::min(threshold, delayed[2 * n + 1] * gain[n]));
+	}
+	std::copy(delayed.begin() + 2 * frames, delayed.begin() + 2 * (frames + Lookahead), delayed.begin());
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+/*
+ * Limiter keeps a stereo signal's peaks at or below a threshold, looking a little ahead so that
+ * gain reduction fades in before each peak rather than cutting in on it (which would distort):
+ *
+ * Limiter limiter(4096);
+ * //every block: limit 'frames' interleaved stereo frames of 'data' in place:
+ * limiter.process(data, frames, 1.0f, release);
+ *
+ * Output is delayed by 'Lookahead' frames. The gain applied to each frame is the smallest gain any frame
+ * in the next 'Window' needs (held, then recovering through 'release'), averaged over 'Window' frames --
+ * which ramps smoothly, and is never more than the frame itself needs, so the output never exceeds the threshold.
+ *
+ */
+
+#include <cstdint>
+#include <vector>
+
+struct Limiter {
+	static constexpr uint32_t const Window = 64; //frames (a power of two)
+	static constexpr uint32_t const Lookahead = Window - 1; //output delay, in frames
+
+	//'max_frames' is the largest block process() will be given:
+	Limiter(uint32_t max_frames);
+
+	//limit 'frames' (at least Lookahead) interleaved stereo frames of 'data', in place; 'release' is the per-frame
+	// coefficient of the exponential recovery toward unity gain:
+	void process(float *data, uint32_t frames, float threshold, float release);
+
+	//forget delayed input and gain reduction (e.g., after the output has been silenced):
+	void reset();
+
+	//--- internals ---
+	std::vector< float > required; //gain each frame needs: Window from the last block, then this block's
+	std::vector< float > gain; //scratch: held minimum of 'required', then the gain to apply
+	std::vector< float > delayed; //(interleaved) Lookahead frames from the last block, then this block's
+	float envelope = 1.0f; //held gain, after release
+	std::vector< float > recent; //last Window values of 'envelope', a ring...
+	uint32_t recent_next = 0; //...whose oldest entry is this one
+};
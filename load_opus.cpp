@@ -1,54 +1,236 @@
 #include "load_opus.hpp"
 
+#include "simd.hpp"
+
 #include <opusfile.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <memory>
 #include <cmath>
+#include <exception>
 #include <stdexcept>
 #include <iostream>
+#include <thread>
+
+namespace {
+	//Long files are decoded in parallel: the file is split into chunks, each decoded by its own decoder
+	// (opened on the same file and seeked to the start of the chunk with op_pcm_seek, which handles pre-roll).
+	//
+	//A decoder that starts partway through the file doesn't produce bit-identical output right away -- it takes
+	// a little while for its state to converge to what a decoder running from the start would have.
+	//So every chunk except the last decodes 'Overlap' frames past its end, and the seam is placed
+	// where those frames first agree exactly with the next chunk's output for 'MatchRun' frames in a row.
+	//(Both are compared in stereo, before the downmix -- channels that differ can still average the same --
+	// and a run of matching digital silence doesn't count, since decoders that haven't converged can agree on that.)
+
+	constexpr uint32_t const Overlap = 48000 / 2;
+	constexpr uint32_t const MatchRun = 960; //(one 20ms opus frame)
+
+	//files shorter than two of these aren't worth splitting:
+	constexpr ogg_int64_t const MinChunk = 10 * 48000;
+
+	//largest number of frames op_read_float_stereo returns at once (120ms, the longest opus packet):
+	constexpr uint32_t const MaxRead = 5760;
+
+	//decoders running across all load_opus calls (each call's own thread included):
+	// (loads usually run on several of Load.cpp's worker threads at once, so a call only splits its file
+	//  over cores that other decodes aren't using, rather than starting a thread per core every time)
+	std::atomic< uint32_t > decoders{0};
+
+	//---- downmix to mono by averaging ----
+	void downmix_scalar(float const *stereo, uint32_t count, float *mono) {
+		for (uint32_t i = 0; i < count; ++i) {
+			mono[i] = (stereo[2*i] + stereo[2*i+1]) * 0.5f;
+		}
+	}
+
+#ifdef SIMD_X86
+	//four frames per iteration:
+	SIMD_TARGET("sse2")
+	void downmix_sse2(float const *stereo, uint32_t count, float *mono) {
+		__m128 const half = _mm_set1_ps(0.5f);
+		uint32_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			__m128 a = _mm_loadu_ps(stereo + 2*i); //l0 r0 l1 r1
+			__m128 b = _mm_loadu_ps(stereo + 2*i + 4); //l2 r2 l3 r3
+			__m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0));
+			__m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1));
+			_mm_storeu_ps(mono + i, _mm_mul_ps(_mm_add_ps(l, r), half));
+		}
+		downmix_scalar(stereo + 2*i, count - i, mono + i);
+	}
+
+	void (* const downmix)(float const *, uint32_t, float *) = simd_select(downmix_scalar, downmix_sse2, downmix_sse2);
+#else
+	void (* const downmix)(float const *, uint32_t, float *) = downmix_scalar;
+#endif
+
+	std::unique_ptr< OggOpusFile, decltype(&op_free) > open_opus(std::string const &filename) {
+		int err = 0;
+		std::unique_ptr< OggOpusFile, decltype(&op_free) > op(
+			op_open_file(filename.c_str(), &err), //pointer to hold
+			op_free //deletion function
+		);
+		if (err != 0) {
+			throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+		}
+		return op;
+	}
+
+	//decode up to 'count' frames from 'op' into 'out' (mono), then (if 'tail' isn't null) up to tail->size() / 2 more
+	// into 'tail' (stereo), shrinking it to what was decoded; also keeps the first head->size() / 2 frames put in 'out'
+	// in 'head' (stereo, if it isn't null), shrinking it the same way.
+	//returns the number of frames put in 'out' (fewer than 'count' only if the file ended):
+	uint64_t decode(OggOpusFile *op, std::string const &filename, float *out, uint64_t count, std::vector< float > *head, std::vector< float > *tail) {
+		std::vector< float > pcm(2 * MaxRead);
+		uint64_t got = 0;
+		size_t head_size = (head ? std::min< size_t >(head->size() / 2, count) : 0);
+		size_t tail_got = 0;
+		size_t tail_size = (tail ? tail->size() / 2 : 0);
+		while (got < count || tail_got < tail_size) {
+			int ret = op_read_float_stereo(op, pcm.data(), int(pcm.size()));
+			if (ret < 0) {
+				throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+			}
+			if (ret == 0) break;
+			//ret is the number of samples read per channel:
+			uint32_t frames = uint32_t(ret);
+			uint32_t used = uint32_t(std::min< uint64_t >(frames, count - got));
+			downmix(pcm.data(), used, out + got);
+			if (got < head_size) {
+				uint32_t keep = uint32_t(std::min< uint64_t >(used, head_size - got));
+				std::copy(pcm.data(), pcm.data() + 2 * keep, head->data() + 2 * got);
+			}
+			got += used;
+			if (used < frames && tail_got < tail_size) {
+				uint32_t extra = uint32_t(std::min< size_t >(frames - used, tail_size - tail_got));
+				std::copy(pcm.data() + 2 * used, pcm.data() + 2 * (used + extra), tail->data() + 2 * tail_got);
+				tail_got += extra;
+			}
+		}
+		if (head) head->resize(2 * std::min< size_t >(head_size, got));
+		if (tail) tail->resize(2 * tail_got);
+		return got;
+	}
+}
 
 void load_opus(std::string const &filename, std::vector< float > *data_) {
 	assert(data_);
 	auto &data = *data_;
 	data.clear();
 
-	std::cout << "loading '" << filename << "'..."; std::cout.flush();
-
-	//will hold opusfile * int a std::unique_ptr so that it will automatically be deleted:
-	int err = 0;
-	std::unique_ptr< OggOpusFile, decltype(&op_free) > op(
-		op_open_file(filename.c_str(), &err), //pointer to hold
-		op_free //deletion function
-	);
-	if (err != 0) {
-		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
-	}
+	auto op = open_opus(filename);
 
 	//get length in samples:
 	ogg_int64_t length = op_pcm_total(op.get(), -1);
-	if (length >= 0) {
-		data.reserve(length);
-	} else {
+	if (length < 0) {
 		std::cerr << "WARNING: cannot estimate length of '" << filename << "', loading may be slow." << std::endl;
-		length = 0;
-		data.reserve(2*48000);
-	}
-
-	std::vector< float > pcm(2*48000*2, 0.0f); //seems like reads are generally 960 samples so this is definitely overkill
-	for (;;) {
-		int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
-		if (ret >= 0) {
-			//positive return values are the number of samples read per channel; copy into data:
-			data.reserve(data.size() + ret);
-			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
-				data.emplace_back((pcm[2*i] + pcm[2*i+1]) * 0.5f); //downmix to mono by averaging
+		//decode sequentially, growing 'data' as needed:
+		for (uint64_t got = 0; /* later */; /* later */) {
+			data.resize(std::max< size_t >(2 * data.size(), 2 * 48000));
+			got += decode(op.get(), filename, data.data() + got, data.size() - got, nullptr, nullptr);
+			if (got < data.size()) {
+				data.resize(got);
+				break;
 			}
-			if (ret == 0) break;
-		} else {
-			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
 		}
+		std::cout << "loaded '" + filename + "'.\n"; std::cout.flush();
+		return;
+	}
+
+	//split into as many chunks as the file is long enough for, up to the number of cores not already decoding:
+	uint32_t cores = std::max(1U, std::thread::hardware_concurrency());
+	uint32_t wanted = uint32_t(std::min< ogg_int64_t >(cores, length / MinChunk));
+	uint32_t chunks = 1;
+	uint32_t running = decoders.load(std::memory_order_relaxed);
+	do {
+		chunks = std::max(1U, std::min(wanted, (running < cores ? cores - running : 0U)));
+	} while (!decoders.compare_exchange_weak(running, running + chunks, std::memory_order_relaxed));
+	struct Release {
+		uint32_t count;
+		~Release() { decoders.fetch_sub(count, std::memory_order_relaxed); }
+	} release{chunks};
+
+	auto chunk_begin = [&](uint32_t c) -> uint64_t {
+		return uint64_t(length) * c / chunks;
+	};
+
+	data.resize(size_t(length));
+	//(stereo) output of each chunk past its end, and the first frames of each chunk, for stitching the seams:
+	std::vector< std::vector< float > > tails(chunks - 1, std::vector< float >(2 * Overlap));
+	std::vector< std::vector< float > > heads(chunks); //(sized as chunks decode; the first chunk has no seam before it)
+	std::vector< std::exception_ptr > errors(chunks);
+	std::vector< uint64_t > decoded(chunks, 0);
+
+	//decode chunk 'c' straight into its slice of 'data' (plus its tail, if it has one):
+	auto decode_chunk = [&](uint32_t c, OggOpusFile *chunk_op) {
+		uint64_t begin = chunk_begin(c);
+		uint64_t end = chunk_begin(c + 1);
+		if (c > 0) heads[c].resize(2 * Overlap);
+		decoded[c] = decode(chunk_op, filename, data.data() + begin, end - begin, (c > 0 ? &heads[c] : nullptr), (c + 1 < chunks ? &tails[c] : nullptr));
+		if (c + 1 < chunks && decoded[c] < end - begin) {
+			throw std::runtime_error("opus file \"" + filename + "\" ended before its reported length.");
+		}
+	};
+
+	std::vector< std::thread > workers;
+	for (uint32_t c = 1; c < chunks; ++c) {
+		workers.emplace_back([&,c](){
+			try {
+				auto chunk_op = open_opus(filename);
+				int ret = op_pcm_seek(chunk_op.get(), ogg_int64_t(chunk_begin(c)));
+				if (ret != 0) {
+					throw std::runtime_error("opusfile error " + std::to_string(ret) + " seeking in \"" + filename + "\".");
+				}
+				decode_chunk(c, chunk_op.get());
+			} catch (...) {
+				errors[c] = std::current_exception();
+			}
+		});
+	}
+	//(this thread decodes the first chunk)
+	try {
+		decode_chunk(0, op.get());
+	} catch (...) {
+		errors[0] = std::current_exception();
+	}
+	for (auto &worker : workers) {
+		worker.join();
+	}
+	for (auto const &error : errors) {
+		if (error) std::rethrow_exception(error);
+	}
+
+	//the last chunk might come up short if the reported length was wrong:
+	data.resize(size_t(chunk_begin(chunks - 1) + decoded.back()));
+
+	//stitch the seams: use each chunk's own output past its end until the next chunk's output has converged to it:
+	for (uint32_t c = 0; c + 1 < chunks; ++c) {
+		uint64_t seam = chunk_begin(c + 1);
+		std::vector< float > const &tail = tails[c];
+		std::vector< float > const &head = heads[c + 1];
+		size_t limit = std::min(tail.size(), head.size()) / 2;
+		size_t at = 0;
+		uint32_t run = 0; //frames in a row that match...
+		bool heard = false; //...and have any sound in them
+		for (; at < limit && !(run >= MatchRun && heard); ++at) {
+			if (tail[2*at] == head[2*at] && tail[2*at+1] == head[2*at+1]) {
+				run += 1;
+				heard = heard || tail[2*at] != 0.0f || tail[2*at+1] != 0.0f;
+			} else {
+				run = 0;
+				heard = false;
+			}
+		}
+		if (!(run >= MatchRun && heard)) {
+			std::cerr << "WARNING: decoders for '" << filename << "' didn't converge within " << limit << " samples of frame " << seam << "; output there may differ slightly from a sequential decode." << std::endl;
+			run = 0; //(use all of the earlier chunk's output)
+		}
+		downmix(tail.data(), uint32_t(at - run), data.data() + seam);
 	}
 
-	std::cout << " done." << std::endl;
+	//(one insertion, so lines from loads running on other threads don't interleave)
+	std::cout << "loaded '" + filename + "'.\n"; std::cout.flush();
 }
@@ -1,16 +1,68 @@
 #include "load_wav.hpp"
+#include "resample.hpp"
 
 #include <SDL.h>
 
 #include <iostream>
 #include <cassert>
+#include <cstring>
+#include <memory>
 #include <algorithm>
+#include <stdexcept>
 
 constexpr uint32_t AUDIO_RATE = 48000;
 
+//sample readers for each SDL audio format, returning values in [-1,1]:
+// (bytes are assembled explicitly, so these work regardless of the host's byte order)
+namespace {
+	struct ReadU8 { float operator()(Uint8 const *b) const { return (float(b[0]) - 128.0f) * (1.0f / 128.0f); } };
+	struct ReadS8 { float operator()(Uint8 const *b) const { return float(int8_t(b[0])) * (1.0f / 128.0f); } };
+	template< bool BigEndian >
+	struct ReadS16 { float operator()(Uint8 const *b) const {
+		return float(int16_t(BigEndian ? (b[0] << 8 | b[1]) : (b[1] << 8 | b[0]))) * (1.0f / 32768.0f);
+	} };
+	template< bool BigEndian >
+	struct ReadS32 { float operator()(Uint8 const *b) const {
+		uint32_t u = BigEndian ? (uint32_t(b[0]) << 24 | uint32_t(b[1]) << 16 | uint32_t(b[2]) << 8 | uint32_t(b[3]))
+		                       : (uint32_t(b[3]) << 24 | uint32_t(b[2]) << 16 | uint32_t(b[1]) << 8 | uint32_t(b[0]));
+		return float(int32_t(u)) * (1.0f / 2147483648.0f);
+	} };
+	template< bool BigEndian >
+	struct ReadF32 { float operator()(Uint8 const *b) const {
+		uint32_t u = BigEndian ? (uint32_t(b[0]) << 24 | uint32_t(b[1]) << 16 | uint32_t(b[2]) << 8 | uint32_t(b[3]))
+		                       : (uint32_t(b[3]) << 24 | uint32_t(b[2]) << 16 | uint32_t(b[1]) << 8 | uint32_t(b[0]));
+		float f;
+		std::memcpy(&f, &u, sizeof(f));
+		return f;
+	} };
+
+	//convert + downmix + resample in one pass, a chunk of frames at a time (so scratch space stays small and in cache):
+	template< typename Read >
+	void convert(Uint8 const *src, uint32_t frames, uint32_t channels, uint32_t bytes_per_sample, Resampler &resampler, std::vector< float > *data) {
+		constexpr uint32_t const ChunkFrames = 4096;
+		float mono[ChunkFrames];
+		Read read;
+		float const scale = 1.0f / float(channels);
+		for (uint32_t begin = 0; begin < frames; begin += ChunkFrames) {
+			uint32_t count = std::min(ChunkFrames, frames - begin);
+			for (uint32_t f = 0; f < count; ++f) {
+				Uint8 const *frame = src + size_t(begin + f) * channels * bytes_per_sample;
+				float sum = 0.0f;
+				for (uint32_t c = 0; c < channels; ++c) {
+					sum += read(frame + c * bytes_per_sample);
+				}
+				mono[f] = sum * scale; //downmix to mono by averaging
+			}
+			resampler.push(mono, count, data);
+		}
+		resampler.finish(data);
+	}
+}
+
 void load_wav(std::string const &filename, std::vector< float > *data_) {
 	assert(data_);
 	auto &data = *data_;
+	data.clear();
 
 	SDL_AudioSpec audio_spec;
 	Uint8 *audio_buf = nullptr;
@@ -20,31 +72,41 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	if (!have) {
 		throw std::runtime_error("Failed to load WAV file '" + filename + "'; SDL says \"" + std::string(SDL_GetError()) + "\"");
 	}
+	//make sure the buffer is freed even if conversion throws:
+	std::unique_ptr< Uint8, decltype(&SDL_FreeWAV) > audio_buf_owner(audio_buf, SDL_FreeWAV);
 
-	//based on the SDL_AudioCVT example in the docs: https://wiki.libsdl.org/SDL_AudioCVT
-	SDL_AudioCVT cvt;
-	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, 1, AUDIO_RATE);
-	if (cvt.needed) {
-		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono; converting." << std::endl;
-		cvt.len = audio_len;
-		cvt.buf = (Uint8 *)SDL_malloc(cvt.len * cvt.len_mult);
-		SDL_memcpy(cvt.buf, audio_buf, audio_len);
-		SDL_ConvertAudio(&cvt);
-		int final_size = cvt.len_cvt;
-		assert(final_size >= 0 && final_size <= cvt.len * cvt.len_mult && "Converted audio should fit in buffer.");
-		assert(final_size % 4 == 0 && "Converted audio should consist of 4-byte elements.");
-		data.assign(reinterpret_cast< float * >(cvt.buf), reinterpret_cast< float * >(cvt.buf + final_size));
-		SDL_free(cvt.buf);
-	} else {
-		data.assign(reinterpret_cast< float * >(audio_buf), reinterpret_cast< float * >(audio_buf + audio_len));
+	SDL_AudioFormat format = have->format;
+	uint32_t channels = have->channels;
+	uint32_t rate = uint32_t(have->freq);
+	uint32_t bytes_per_sample = SDL_AUDIO_BITSIZE(format) / 8;
+	if (channels == 0 || rate == 0 || bytes_per_sample == 0) {
+		throw std::runtime_error("WAV file '" + filename + "' has an unsupported format.");
 	}
-	SDL_FreeWAV(audio_buf);
+	uint32_t frames = audio_len / (channels * bytes_per_sample);
 
-	float min = 0.0f;
-	float max = 0.0f;
-	for (auto d : data) {
-		min = std::min(min, d);
-		max = std::max(max, d);
+	if (!(format == AUDIO_F32SYS && channels == 1 && rate == AUDIO_RATE)) {
+		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono"
+			+ " (it's " + std::to_string(rate) + " Hz, " + std::to_string(SDL_AUDIO_BITSIZE(format)) + "-bit, " + std::to_string(channels) + " channel); converting.\n";
+		std::cout.flush();
+	}
+
+	Resampler resampler(rate, AUDIO_RATE);
+	data.reserve(size_t(resampler.output_length(frames)));
+
+	bool big = SDL_AUDIO_ISBIGENDIAN(format);
+	if (SDL_AUDIO_ISFLOAT(format) && bytes_per_sample == 4) {
+		if (big) convert< ReadF32< true > >(audio_buf, frames, channels, 4, resampler, &data);
+		else convert< ReadF32< false > >(audio_buf, frames, channels, 4, resampler, &data);
+	} else if (!SDL_AUDIO_ISFLOAT(format) && bytes_per_sample == 4 && SDL_AUDIO_ISSIGNED(format)) {
+		if (big) convert< ReadS32< true > >(audio_buf, frames, channels, 4, resampler, &data);
+		else convert< ReadS32< false > >(audio_buf, frames, channels, 4, resampler, &data);
+	} else if (!SDL_AUDIO_ISFLOAT(format) && bytes_per_sample == 2 && SDL_AUDIO_ISSIGNED(format)) {
+		if (big) convert< ReadS16< true > >(audio_buf, frames, channels, 2, resampler, &data);
+		else convert< ReadS16< false > >(audio_buf, frames, channels, 2, resampler, &data);
+	} else if (!SDL_AUDIO_ISFLOAT(format) && bytes_per_sample == 1) {
+		if (SDL_AUDIO_ISSIGNED(format)) convert< ReadS8 >(audio_buf, frames, channels, 1, resampler, &data);
+		else convert< ReadU8 >(audio_buf, frames, channels, 1, resampler, &data);
+	} else {
+		throw std::runtime_error("WAV file '" + filename + "' has an unsupported sample format.");
 	}
-	std::cout << "Range: " << min << ", " << max << std::endl;
 }
@@ -93,7 +93,13 @@ int main(int argc, char **argv) {
 	//SDL_ShowCursor(SDL_DISABLE);
 
 	//------------ init sound --------------
-	Sound::init();
+	{
+		//players locate zombies by ear, so start with low-latency (small) mix blocks, growing them if this machine can't keep up:
+		Sound::Settings settings;
+		settings.block_size = 256;
+		settings.adaptive_block_size = true;
+		Sound::init(settings);
+	}
 
 	//------------ load assets --------------
 	call_load_functions();
@@ -170,6 +176,8 @@ int main(int argc, char **argv) {
 
 			Mode::current->update(elapsed);
 			if (!Mode::current) break;
+
+			Sound::update();
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
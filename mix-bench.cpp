@@ -0,0 +1,117 @@
+//Micro-benchmark for the Sound mixer's inner loop:
+// plays N looping voices (half 2D, half 3D, all with moving pans) and times
+// mixing (via the null backend's Sound::render()) with each sample encoding and available mixing kernel.
+//
+// usage: mix-bench [voices ...]   (default: 16 64 128 256)
+
+#include "Sound.hpp"
+#include "mix_kernel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+constexpr uint32_t BLOCK_FRAMES = Sound::MIX_SAMPLES;
+constexpr uint32_t AUDIO_RATE = Sound::AUDIO_RATE;
+
+int main(int argc, char **argv) {
+	std::vector< uint32_t > voice_counts;
+	for (int a = 1; a < argc; ++a) {
+		voice_counts.emplace_back(uint32_t(std::stoul(argv[a])));
+	}
+	if (voice_counts.empty()) voice_counts = { 16, 64, 128, 256 };
+
+	//a handful of samples with awkward (non-multiple-of-vector) lengths, so loop points land mid-block:
+	std::mt19937 mt(0x15466);
+	//(stored in each encoding)
+	std::vector< std::pair< char const *, Sound::Sample::Encoding > > const encodings{
+		{"float32", Sound::Sample::Float32}, {"int16", Sound::Sample::Int16}, {"adpcm", Sound::Sample::ADPCM}
+	};
+	std::vector< std::vector< Sound::Sample > > samples(encodings.size());
+	for (uint32_t s = 0; s < 8; ++s) {
+		std::vector< float > data(AUDIO_RATE / 2 + 37 * s + 3);
+		for (auto &d : data) d = std::uniform_real_distribution< float >(-0.5f, 0.5f)(mt);
+		for (uint32_t e = 0; e < encodings.size(); ++e) {
+			samples[e].emplace_back(data, encodings[e].second);
+		}
+	}
+
+	std::vector< MixMonoFn > kernels;
+	for (MixMonoFn fn : { mix_mono_scalar, mix_mono_sse2, mix_mono_avx2 }) {
+		if (fn) kernels.emplace_back(fn);
+	}
+
+	std::cout << "Mixing " << BLOCK_FRAMES << "-frame blocks; budget is "
+	          << (1000.0 * BLOCK_FRAMES / AUDIO_RATE) << " ms/block (default kernel: " << mix_mono_name(mix_mono) << ")." << std::endl;
+	std::cout << std::setw(8) << "voices" << std::setw(10) << "encoding" << std::setw(10) << "kernel"
+	          << std::setw(14) << "ns/frame" << std::setw(18) << "ns/voice-frame"
+	          << std::setw(14) << "ms/block" << std::setw(12) << "% budget" << std::endl;
+
+	//size the voice pool for the largest test; the null backend leaves mixing to Sound::render():
+	Sound::Settings settings;
+	settings.backend = Sound::Settings::Backend::Null;
+	settings.max_voices = *std::max_element(voice_counts.begin(), voice_counts.end());
+	Sound::init(settings);
+
+	std::vector< float > buffer(2 * BLOCK_FRAMES);
+	for (uint32_t voices : voice_counts) {
+		for (uint32_t e = 0; e < encodings.size(); ++e) {
+			std::vector< Sound::PlayingSample > playing;
+			for (uint32_t v = 0; v < voices; ++v) {
+				Sound::Sample const &sample = samples[e][v % samples[e].size()];
+				if (v % 2) {
+					playing.emplace_back(Sound::loop(sample, 0.5f, 0.0f));
+				} else {
+					playing.emplace_back(Sound::loop_3D(sample, 0.5f, glm::vec3(float(v), 1.0f, 0.0f), 4.0f));
+				}
+			}
+
+			for (MixMonoFn kernel : kernels) {
+				mix_mono = kernel;
+				mix_mono_i16 = mix_mono_i16_matching(kernel);
+				//warm up (also applies the queued play commands):
+				for (uint32_t b = 0; b < 8; ++b) {
+					Sound::render(buffer.data(), BLOCK_FRAMES);
+				}
+
+				constexpr uint32_t Blocks = 200;
+				auto before = std::chrono::high_resolution_clock::now();
+				for (uint32_t b = 0; b < Blocks; ++b) {
+					//keep the pan ramps busy so every block interpolates gains:
+					for (uint32_t v = 0; v < voices; ++v) {
+						if (v % 2) {
+							playing[v].set_pan(std::sin(0.1f * float(b + v)));
+						} else {
+							playing[v].set_position(glm::vec3(std::cos(0.1f * float(b + v)), 1.0f, 0.0f));
+						}
+					}
+					Sound::render(buffer.data(), BLOCK_FRAMES);
+				}
+				auto after = std::chrono::high_resolution_clock::now();
+
+				double ns = std::chrono::duration< double, std::nano >(after - before).count();
+				double ns_per_frame = ns / (double(Blocks) * BLOCK_FRAMES);
+				double ms_per_block = ns / Blocks * 1e-6;
+				std::cout << std::setw(8) << voices << std::setw(10) << encodings[e].first << std::setw(10) << mix_mono_name(kernel)
+				          << std::setw(14) << std::fixed << std::setprecision(2) << ns_per_frame
+				          << std::setw(18) << std::setprecision(3) << (ns_per_frame / voices)
+				          << std::setw(14) << std::setprecision(3) << ms_per_block
+				          << std::setw(12) << std::setprecision(1) << (100.0 * ms_per_block / (1000.0 * BLOCK_FRAMES / AUDIO_RATE))
+				          << std::endl;
+			}
+
+			for (auto &p : playing) {
+				p.stop(0.0f);
+			}
+			Sound::render(buffer.data(), BLOCK_FRAMES);
+		}
+	}
+
+	Sound::shutdown();
+
+	return 0;
+}
@@ -0,0 +1,262 @@
+//Offline mixer run: plays a scripted scenario (one-shots, loops, pans, 3D moves, listener motion)
+// through the Sound mixer's null backend, as fast as it will go, and writes the result to a WAV file.
+// Reports per-block mixing time percentiles and a checksum of the output.
+//
+// The scenario only uses generated samples and a fixed random seed, so the output is the same on
+// every run of the same build -- compare checksums (or the WAV files) before and after a change
+// to check that it is bit-exact.
+//
+// The last bits of the output depend on the build, though: the SIMD kernels round differently (the
+// checksum is reported along with the kernel level; set SIMD_LEVEL=scalar|sse2|avx2 to pick one),
+// as do glm's vector math and the C library's sin(). So a default-length run is checked against
+// 'ReferenceLevels' below instead, within 'LevelTolerance': rounding differences (under about 2e-5
+// per sample) move those levels by less than 1e-6, while, e.g., making the background loop 1% louder
+// moves them by about 4e-4.
+// A change that alters the mix must update those on purpose, and say why.
+//
+// usage: mix-render [seconds] [output.wav]   (defaults: 30 mix-render.wav)
+
+#include "Sound.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//write interleaved stereo float data as a 32-bit float WAV file:
+static void write_wav(std::string const &filename, std::vector< float > const &data) {
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+
+	auto write_u32 = [&](uint32_t v) { out.write(reinterpret_cast< char const * >(&v), 4); };
+	auto write_u16 = [&](uint16_t v) { out.write(reinterpret_cast< char const * >(&v), 2); };
+	//n.b. WAV is little-endian, as are all the platforms this code targets.
+
+	uint32_t data_bytes = uint32_t(data.size() * sizeof(float));
+	out.write("RIFF", 4);
+	write_u32(4 + (8 + 16) + (8 + data_bytes));
+	out.write("WAVE", 4);
+
+	out.write("fmt ", 4);
+	write_u32(16);
+	write_u16(3); //WAVE_FORMAT_IEEE_FLOAT
+	write_u16(2); //channels
+	write_u32(Sound::AUDIO_RATE);
+	write_u32(Sound::AUDIO_RATE * 2 * sizeof(float)); //bytes per second
+	write_u16(2 * sizeof(float)); //bytes per frame
+	write_u16(32); //bits per sample
+
+	out.write("data", 4);
+	write_u32(data_bytes);
+	out.write(reinterpret_cast< char const * >(data.data()), data_bytes);
+
+	if (!out) throw std::runtime_error("Failed to write '" + filename + "'.");
+}
+
+//RMS level of each second of the default (30 second) run, { left, right }:
+static float const ReferenceLevels[][2] = {
+	{ 0.198710f, 0.136748f }, { 0.137149f, 0.172767f }, { 0.130423f, 0.160360f },
+	{ 0.129536f, 0.138441f }, { 0.123418f, 0.159552f }, { 0.097864f, 0.169011f },
+	{ 0.142562f, 0.181883f }, { 0.173666f, 0.135861f }, { 0.151603f, 0.116752f },
+	{ 0.169170f, 0.102481f }, { 0.195268f, 0.126343f }, { 0.157323f, 0.140269f },
+	{ 0.134120f, 0.152370f }, { 0.151856f, 0.142916f }, { 0.199171f, 0.144311f },
+	{ 0.143312f, 0.107591f }, { 0.056914f, 0.071424f }, { 0.058844f, 0.076310f },
+	{ 0.094219f, 0.069573f }, { 0.078994f, 0.052684f }, { 0.079318f, 0.047560f },
+	{ 0.076774f, 0.046851f }, { 0.101206f, 0.057404f }, { 0.190254f, 0.165985f },
+	{ 0.169600f, 0.156372f }, { 0.085291f, 0.140852f }, { 0.126374f, 0.148586f },
+	{ 0.130876f, 0.179062f }, { 0.099023f, 0.151789f }, { 0.118751f, 0.151373f },
+};
+static double const LevelTolerance = 1e-5;
+
+int main(int argc, char **argv) {
+	float const DefaultSeconds = 30.0f;
+	float seconds = DefaultSeconds;
+	std::string output = "mix-render.wav";
+	if (argc > 1) seconds = std::stof(argv[1]);
+	if (argc > 2) output = argv[2];
+	if (argc > 3 || !(seconds > 0.0f)) {
+		std::cerr << "usage:\n\t" << argv[0] << " [seconds] [output.wav]" << std::endl;
+		return 1;
+	}
+
+	Sound::Settings settings;
+	settings.backend = Sound::Settings::Backend::Null;
+	settings.max_voices = 64;
+	Sound::init(settings);
+
+	//--- generated samples ---
+	std::mt19937 mt(0x15466);
+	auto random = [&mt](float lo, float hi) { return std::uniform_real_distribution< float >(lo, hi)(mt); };
+
+	constexpr float Tau = 6.2831853f;
+	float const rate = float(Sound::AUDIO_RATE);
+
+	//a soft chord, for the 2D background loop:
+	std::vector< float > pad(Sound::AUDIO_RATE * 2 + 11);
+	for (uint32_t i = 0; i < pad.size(); ++i) {
+		float t = float(i) / rate;
+		pad[i] = 0.1f * (std::sin(Tau * 220.0f * t) + std::sin(Tau * 277.2f * t) + std::sin(Tau * 329.6f * t));
+	}
+	//buzzes at a few pitches, for the 3D "entity" loops:
+	std::vector< Sound::Sample > buzzes;
+	for (uint32_t b = 0; b < 4; ++b) {
+		std::vector< float > data(Sound::AUDIO_RATE / 2 + 97 * b);
+		float freq = 110.0f * (1.0f + 0.5f * float(b));
+		for (uint32_t i = 0; i < data.size(); ++i) {
+			float phase = std::fmod(freq * float(i) / rate, 1.0f);
+			data[i] = 0.3f * (2.0f * phase - 1.0f);
+		}
+		buzzes.emplace_back(data);
+	}
+	//decaying noise bursts and chirps, for one-shots:
+	std::vector< Sound::Sample > hits;
+	for (uint32_t h = 0; h < 4; ++h) {
+		std::vector< float > data(Sound::AUDIO_RATE / 4 + 1013 * h);
+		for (uint32_t i = 0; i < data.size(); ++i) {
+			float t = float(i) / rate;
+			float env = std::exp(-12.0f * t);
+			data[i] = env * ((h % 2) ? random(-0.8f, 0.8f) : 0.8f * std::sin(Tau * (400.0f + 1600.0f * t) * t));
+		}
+		hits.emplace_back(data);
+	}
+	Sound::Sample pad_sample(pad);
+
+	//--- scenario ---
+	uint32_t blocks = uint32_t(std::ceil(seconds * rate / float(Sound::MIX_SAMPLES)));
+	float const block_time = float(Sound::MIX_SAMPLES) / rate;
+
+	std::vector< float > mixed(2 * size_t(blocks) * Sound::MIX_SAMPLES);
+	std::vector< double > block_ms;
+	block_ms.reserve(blocks);
+
+	Sound::PlayingSample background = Sound::loop(pad_sample, 0.5f, 0.0f);
+
+	struct Entity {
+		Sound::PlayingSample sound;
+		float radius;
+		float speed;
+		float angle;
+	};
+	std::vector< Entity > entities;
+	for (uint32_t e = 0; e < 16; ++e) {
+		Entity entity;
+		entity.radius = random(1.0f, 12.0f);
+		entity.speed = random(-2.0f, 2.0f);
+		entity.angle = random(0.0f, Tau);
+		entity.sound = Sound::loop_3D(buzzes[e % buzzes.size()], 0.5f, glm::vec3(entity.radius, 0.0f, 0.0f), 2.0f);
+		entities.emplace_back(entity);
+	}
+
+	float next_hit = 0.0f;
+	for (uint32_t b = 0; b < blocks; ++b) {
+		float t = float(b) * block_time;
+
+		//the script -- these queue commands, which take effect at the start of the next block:
+		background.set_pan(std::sin(0.25f * Tau * t));
+		for (auto &entity : entities) {
+			entity.angle += entity.speed * block_time;
+			entity.sound.set_position(glm::vec3(entity.radius * std::cos(entity.angle), entity.radius * std::sin(entity.angle), 0.0f));
+		}
+		float look = 0.1f * Tau * t;
+		Sound::listener.set_position_right(glm::vec3(2.0f * std::sin(0.05f * Tau * t), 0.0f, 0.0f), glm::vec3(std::cos(look), std::sin(look), 0.0f));
+		if (t >= next_hit) {
+			Sound::Sample const &hit = hits[mt() % hits.size()];
+			if (mt() % 2) {
+				Sound::play(hit, random(0.2f, 1.0f), random(-1.0f, 1.0f));
+			} else {
+				Sound::play_3D(hit, random(0.2f, 1.0f), glm::vec3(random(-8.0f, 8.0f), random(-8.0f, 8.0f), 0.0f), 3.0f);
+			}
+			next_hit += random(0.05f, 0.5f);
+		}
+		if (b == blocks / 2) {
+			//dip the global volume and silence a few entities partway through:
+			Sound::set_volume(0.5f, 1.0f);
+			for (uint32_t e = 0; e < entities.size(); e += 4) {
+				entities[e].sound.set_volume(0.0f, 0.5f);
+			}
+		}
+		if (b == (3 * blocks) / 4) {
+			Sound::set_volume(1.0f, 1.0f);
+			entities.back().sound.stop(0.25f);
+		}
+
+		auto before = std::chrono::high_resolution_clock::now();
+		Sound::render(mixed.data() + 2 * size_t(b) * Sound::MIX_SAMPLES, Sound::MIX_SAMPLES);
+		auto after = std::chrono::high_resolution_clock::now();
+		block_ms.emplace_back(std::chrono::duration< double, std::milli >(after - before).count());
+	}
+
+	//--- report ---
+	double total_ms = 0.0;
+	for (double ms : block_ms) total_ms += ms;
+	std::vector< double > sorted = block_ms;
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&sorted](double p) {
+		return sorted[std::min(sorted.size() - 1, size_t(p / 100.0 * double(sorted.size())))];
+	};
+	double budget_ms = 1000.0 * block_time;
+
+	//FNV-1a over the output's bits:
+	uint64_t checksum = 0xcbf29ce484222325ULL;
+	for (float f : mixed) {
+		uint32_t bits;
+		std::memcpy(&bits, &f, sizeof(bits));
+		for (uint32_t i = 0; i < 4; ++i) {
+			checksum = (checksum ^ ((bits >> (8 * i)) & 0xff)) * 0x100000001b3ULL;
+		}
+	}
+
+	std::cout << "Rendered " << blocks << " blocks (" << (blocks * block_time) << " s) in " << std::fixed << std::setprecision(1) << total_ms << " ms"
+	          << " (" << std::setprecision(1) << (1000.0 * blocks * block_time / total_ms) << "x real time)." << std::endl;
+	std::cout << std::setw(12) << "block" << std::setw(12) << "ms" << std::setw(12) << "% budget" << std::endl;
+	for (auto const &p : std::vector< std::pair< char const *, double > >{
+		{"p50", percentile(50.0)}, {"p90", percentile(90.0)}, {"p99", percentile(99.0)}, {"max", sorted.back()} }) {
+		std::cout << std::setw(12) << p.first << std::setw(12) << std::setprecision(3) << p.second
+		          << std::setw(12) << std::setprecision(1) << (100.0 * p.second / budget_ms) << std::endl;
+	}
+	SimdLevel level = simd_level();
+	std::cout << "Output checksum: " << std::hex << std::setw(16) << std::setfill('0') << checksum << std::dec << std::setfill(' ')
+	          << " (" << simd_level_name(level) << " kernels)" << std::endl;
+
+	write_wav(output, mixed);
+	std::cout << "Wrote '" << output << "'." << std::endl;
+
+	Sound::shutdown();
+
+	if (seconds == DefaultSeconds) {
+		//RMS level of each whole second of output, per channel:
+		uint32_t const count = uint32_t(sizeof(ReferenceLevels) / sizeof(ReferenceLevels[0]));
+		double worst = 0.0;
+		uint32_t worst_second = 0;
+		for (uint32_t second = 0; second < count; ++second) {
+			for (uint32_t c = 0; c < 2; ++c) {
+				double sum = 0.0;
+				for (uint32_t i = 0; i < Sound::AUDIO_RATE; ++i) {
+					double v = mixed[2 * (size_t(second) * Sound::AUDIO_RATE + i) + c];
+					sum += v * v;
+				}
+				double level = std::sqrt(sum / Sound::AUDIO_RATE);
+				double error = std::abs(level - double(ReferenceLevels[second][c]));
+				if (error > worst) {
+					worst = error;
+					worst_second = second;
+				}
+			}
+		}
+		if (worst > LevelTolerance) {
+			std::cout << "Output level DIFFERS from the reference by " << std::scientific << std::setprecision(2) << worst
+			          << " (tolerance " << LevelTolerance << ") in second " << worst_second << "." << std::endl;
+			return 2;
+		}
+		std::cout << "Output levels match the reference (within " << std::scientific << std::setprecision(0) << LevelTolerance << ")." << std::endl;
+	}
+	return 0;
+}
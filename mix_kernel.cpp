@@ -0,0 +1,170 @@
+#include "mix_kernel.hpp"
+
+#include "simd.hpp"
+
+#include <SDL.h>
+
+//Kernels are templates over the stored sample type (float or int16_t); int16 samples are converted
+// to float as they are loaded, and the 1/32768 scale is folded into the gains (see mix_i16 below).
+
+//---------------- scalar ----------------
+
+template< typename T >
+static void mix_scalar(T const *data, uint32_t count, float *out,
+	float *gain_l, float *gain_r, float step_l, float step_r) {
+	float l = *gain_l;
+	float r = *gain_r;
+	for (uint32_t i = 0; i < count; ++i) {
+		float d = float(data[i]);
+		out[2*i+0] += l * d;
+		out[2*i+1] += r * d;
+		l += step_l;
+		r += step_r;
+	}
+	*gain_l = l;
+	*gain_r = r;
+}
+
+#ifdef SIMD_X86
+
+//---------------- SSE2 ----------------
+//four frames (= two output vectors) per iteration:
+
+SIMD_TARGET("sse2")
+static inline __m128 load4(float const *data) {
+	return _mm_loadu_ps(data);
+}
+
+SIMD_TARGET("sse2")
+static inline __m128 load4(int16_t const *data) {
+	__m128i d = _mm_loadl_epi64(reinterpret_cast< __m128i const * >(data));
+	//sign-extend to 32 bits by unpacking into the high halves and shifting back down:
+	return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(d, d), 16));
+}
+
+template< typename T >
+SIMD_TARGET("sse2")
+static void mix_sse2(T const *data, uint32_t count, float *out,
+	float *gain_l, float *gain_r, float step_l, float step_r) {
+	uint32_t i = 0;
+	if (count >= 4) {
+		//gains for frames 0,1 and 2,3 (as l,r,l,r):
+		__m128 g01 = _mm_setr_ps(*gain_l, *gain_r, *gain_l + step_l, *gain_r + step_r);
+		__m128 g23 = _mm_add_ps(g01, _mm_setr_ps(2.0f * step_l, 2.0f * step_r, 2.0f * step_l, 2.0f * step_r));
+		__m128 step4 = _mm_setr_ps(4.0f * step_l, 4.0f * step_r, 4.0f * step_l, 4.0f * step_r);
+		for (; i + 4 <= count; i += 4) {
+			__m128 d = load4(data + i);
+			__m128 d01 = _mm_unpacklo_ps(d, d); //d0 d0 d1 d1
+			__m128 d23 = _mm_unpackhi_ps(d, d); //d2 d2 d3 d3
+			float *o = out + 2*i;
+			_mm_storeu_ps(o + 0, _mm_add_ps(_mm_loadu_ps(o + 0), _mm_mul_ps(g01, d01)));
+			_mm_storeu_ps(o + 4, _mm_add_ps(_mm_loadu_ps(o + 4), _mm_mul_ps(g23, d23)));
+			g01 = _mm_add_ps(g01, step4);
+			g23 = _mm_add_ps(g23, step4);
+		}
+		*gain_l += float(i) * step_l;
+		*gain_r += float(i) * step_r;
+	}
+	//leftover frames:
+	mix_scalar(data + i, count - i, out + 2*i, gain_l, gain_r, step_l, step_r);
+}
+
+//---------------- AVX2 ----------------
+//eight frames (= two output vectors) per iteration:
+
+SIMD_TARGET("avx2")
+static inline __m256 load8(float const *data) {
+	return _mm256_loadu_ps(data);
+}
+
+SIMD_TARGET("avx2")
+static inline __m256 load8(int16_t const *data) {
+	return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast< __m128i const * >(data))));
+}
+
+template< typename T >
+SIMD_TARGET("avx2")
+static void mix_avx2(T const *data, uint32_t count, float *out,
+	float *gain_l, float *gain_r, float step_l, float step_r) {
+	uint32_t i = 0;
+	if (count >= 8) {
+		float const l = *gain_l;
+		float const r = *gain_r;
+		//gains for frames 0-3 and 4-7 (as l,r,l,r,...):
+		__m256 g0 = _mm256_setr_ps(
+			l, r, l + step_l, r + step_r,
+			l + 2.0f * step_l, r + 2.0f * step_r, l + 3.0f * step_l, r + 3.0f * step_r);
+		__m256 g1 = _mm256_add_ps(g0, _mm256_setr_ps(
+			4.0f * step_l, 4.0f * step_r, 4.0f * step_l, 4.0f * step_r,
+			4.0f * step_l, 4.0f * step_r, 4.0f * step_l, 4.0f * step_r));
+		__m256 step8 = _mm256_setr_ps(
+			8.0f * step_l, 8.0f * step_r, 8.0f * step_l, 8.0f * step_r,
+			8.0f * step_l, 8.0f * step_r, 8.0f * step_l, 8.0f * step_r);
+		for (; i + 8 <= count; i += 8) {
+			__m256 d = load8(data + i);
+			//unpack works within 128-bit lanes, so shuffle the lanes back into frame order afterward:
+			__m256 lo = _mm256_unpacklo_ps(d, d); //d0 d0 d1 d1 | d4 d4 d5 d5
+			__m256 hi = _mm256_unpackhi_ps(d, d); //d2 d2 d3 d3 | d6 d6 d7 d7
+			__m256 d0 = _mm256_permute2f128_ps(lo, hi, 0x20); //d0 d0 d1 d1 d2 d2 d3 d3
+			__m256 d1 = _mm256_permute2f128_ps(lo, hi, 0x31); //d4 d4 d5 d5 d6 d6 d7 d7
+			float *o = out + 2*i;
+			_mm256_storeu_ps(o + 0, _mm256_add_ps(_mm256_loadu_ps(o + 0), _mm256_mul_ps(g0, d0)));
+			_mm256_storeu_ps(o + 8, _mm256_add_ps(_mm256_loadu_ps(o + 8), _mm256_mul_ps(g1, d1)));
+			g0 = _mm256_add_ps(g0, step8);
+			g1 = _mm256_add_ps(g1, step8);
+		}
+		*gain_l += float(i) * step_l;
+		*gain_r += float(i) * step_r;
+	}
+	//leftover frames:
+	mix_sse2(data + i, count - i, out + 2*i, gain_l, gain_r, step_l, step_r);
+}
+
+#endif //SIMD_X86
+
+//---------------- int16 ----------------
+//int16 data is mixed with gains scaled by 1/32768 (a power of two, so scaling the gains back afterward is exact):
+
+template< void (*Mix)(int16_t const *, uint32_t, float *, float *, float *, float, float) >
+static void mix_i16(int16_t const *data, uint32_t count, float *out,
+	float *gain_l, float *gain_r, float step_l, float step_r) {
+	constexpr float const Scale = 1.0f / 32768.0f;
+	float l = *gain_l * Scale;
+	float r = *gain_r * Scale;
+	Mix(data, count, out, &l, &r, step_l * Scale, step_r * Scale);
+	*gain_l = l * 32768.0f;
+	*gain_r = r * 32768.0f;
+}
+
+//---------------- dispatch ----------------
+
+MixMonoFn const mix_mono_scalar = mix_scalar< float >;
+MixMonoI16Fn const mix_mono_i16_scalar = mix_i16< mix_scalar< int16_t > >;
+#ifdef SIMD_X86
+MixMonoFn const mix_mono_sse2 = (SDL_HasSSE2() ? mix_sse2< float > : nullptr);
+MixMonoFn const mix_mono_avx2 = (SDL_HasAVX2() ? mix_avx2< float > : nullptr);
+MixMonoI16Fn const mix_mono_i16_sse2 = (SDL_HasSSE2() ? mix_i16< mix_sse2< int16_t > > : nullptr);
+MixMonoI16Fn const mix_mono_i16_avx2 = (SDL_HasAVX2() ? mix_i16< mix_avx2< int16_t > > : nullptr);
+#else
+MixMonoFn const mix_mono_sse2 = nullptr;
+MixMonoFn const mix_mono_avx2 = nullptr;
+MixMonoI16Fn const mix_mono_i16_sse2 = nullptr;
+MixMonoI16Fn const mix_mono_i16_avx2 = nullptr;
+#endif
+
+MixMonoFn mix_mono = simd_select(mix_mono_scalar, mix_mono_sse2, mix_mono_avx2);
+MixMonoI16Fn mix_mono_i16 = simd_select(mix_mono_i16_scalar, mix_mono_i16_sse2, mix_mono_i16_avx2);
+
+MixMonoI16Fn mix_mono_i16_matching(MixMonoFn fn) {
+	if (fn == mix_mono_avx2 && mix_mono_i16_avx2) return mix_mono_i16_avx2;
+	if (fn == mix_mono_sse2 && mix_mono_i16_sse2) return mix_mono_i16_sse2;
+	return mix_mono_i16_scalar;
+}
+
+char const *mix_mono_name(MixMonoFn fn) {
+	if (fn == nullptr) return "(none)";
+	if (fn == mix_mono_scalar) return "scalar";
+	if (fn == mix_mono_sse2) return "sse2";
+	if (fn == mix_mono_avx2) return "avx2";
+	return "(unknown)";
+}
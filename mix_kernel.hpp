@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+//Inner loop of the audio mixer:
+// adds 'count' mono samples from 'data' into the interleaved stereo buffer 'out',
+// scaling by a per-channel gain that starts at (*gain_l, *gain_r) and
+// increases by (step_l, step_r) every frame.
+// On return, (*gain_l, *gain_r) hold the gain for the frame after the last one mixed,
+// so consecutive calls continue the same ramp.
+typedef void (*MixMonoFn)(float const *data, uint32_t count, float *out,
+	float *gain_l, float *gain_r, float step_l, float step_r);
+
+//Same, for 16-bit samples (which are treated as fractions of 32768):
+typedef void (*MixMonoI16Fn)(int16_t const *data, uint32_t count, float *out,
+	float *gain_l, float *gain_r, float step_l, float step_r);
+
+//The available implementations (null if not supported by this compiler/CPU):
+extern MixMonoFn const mix_mono_scalar;
+extern MixMonoFn const mix_mono_sse2;
+extern MixMonoFn const mix_mono_avx2;
+extern MixMonoI16Fn const mix_mono_i16_scalar;
+extern MixMonoI16Fn const mix_mono_i16_sse2;
+extern MixMonoI16Fn const mix_mono_i16_avx2;
+
+//The implementation used by Sound's mixer; set at startup to the one for simd_level() (see simd.hpp) -- the fastest the CPU supports, by default.
+// (benchmarks may overwrite it to compare implementations)
+extern MixMonoFn mix_mono;
+extern MixMonoI16Fn mix_mono_i16;
+
+//the int16 implementation that uses the same instructions as a float one (e.g., for benchmarks that swap 'mix_mono'):
+MixMonoI16Fn mix_mono_i16_matching(MixMonoFn fn);
+
+//human-readable name of an implementation (e.g., "avx2"):
+char const *mix_mono_name(MixMonoFn fn);
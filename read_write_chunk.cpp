@@ -0,0 +1,113 @@
+#include "read_write_chunk.hpp"
+
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+ChunkFile::ChunkFile(std::string const &filename_) : filename(filename_) {
+	#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open '" + filename + "' for reading.");
+	}
+	file_handle = file;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(file_size.QuadPart);
+	if (size > 0) { //(can't map an empty file)
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			CloseHandle(file);
+			throw std::runtime_error("Failed to map '" + filename + "'.");
+		}
+		mapping_handle = mapping;
+		mapped = reinterpret_cast< char const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!mapped) {
+			CloseHandle(mapping);
+			CloseHandle(file);
+			throw std::runtime_error("Failed to map '" + filename + "'.");
+		}
+	}
+	#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("Failed to open '" + filename + "' for reading.");
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(info.st_size);
+	if (size > 0) { //(can't map an empty file)
+		void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Failed to map '" + filename + "'.");
+		}
+		//chunks are read front-to-back, once:
+		madvise(addr, size, MADV_SEQUENTIAL);
+		mapped = reinterpret_cast< char const * >(addr);
+	}
+	close(fd); //(the mapping stays valid after the descriptor is closed)
+	#endif
+}
+
+ChunkFile::~ChunkFile() {
+	#if defined(_WIN32)
+	if (mapped) UnmapViewOfFile(mapped);
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle) CloseHandle(file_handle);
+	#else
+	if (mapped) munmap(const_cast< char * >(mapped), size);
+	#endif
+}
+
+void const *ChunkFile::read_bytes(std::string const &magic, size_t element_size, size_t element_align, size_t *size_) {
+	assert(magic.size() == 4);
+	assert(size_);
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	ChunkHeader header;
+	if (size - offset < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, mapped + offset, sizeof(header));
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	if (header.size % element_size != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+
+	if (size - offset - sizeof(header) < header.size) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+	char const *data = mapped + offset + sizeof(header);
+	offset += sizeof(header) + header.size;
+	*size_ = header.size;
+
+	if (reinterpret_cast< uintptr_t >(data) % element_align != 0) {
+		//(new[]'d storage is aligned for any fundamental type)
+		realigned.emplace_back(new char[header.size]);
+		std::memcpy(realigned.back().get(), data, header.size);
+		data = realigned.back().get();
+	}
+	return data;
+}
@@ -2,8 +2,13 @@
 
 #include <iostream>
 #include <vector>
+#include <memory>
+#include <string>
 #include <stdexcept>
+#include <type_traits>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -63,3 +68,70 @@ void write_chunk(std::string const &magic, std::vector< T > const &from, std::os
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
+
+
+//read-only view of an array of T (like c++20's std::span< T const >):
+template< typename T >
+struct ChunkSpan {
+	ChunkSpan() = default;
+	ChunkSpan(T const *data_, size_t size_) : ptr(data_), count(size_) { }
+
+	T const *data() const { return ptr; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	T const &operator[](size_t i) const { assert(i < count); return ptr[i]; }
+	T const *begin() const { return ptr; }
+	T const *end() const { return ptr + count; }
+
+	T const *ptr = nullptr;
+	size_t count = 0;
+};
+
+//reads chunks (in the same format as read_chunk) straight out of a memory-mapped file:
+// spans returned by read() point into the mapping, so they are only valid while the ChunkFile exists.
+struct ChunkFile {
+	//map file (throws if it can't be opened):
+	ChunkFile(std::string const &filename);
+	~ChunkFile();
+
+	ChunkFile(ChunkFile const &) = delete;
+	ChunkFile &operator=(ChunkFile const &) = delete;
+
+	//read the next chunk as an array of T (throws if the magic number or size is wrong):
+	// note: chunk data that isn't aligned for T (e.g., following an odd-length string chunk) is copied to aligned storage.
+	template< typename T >
+	ChunkSpan< T > read(std::string const &magic) {
+		static_assert(std::is_trivially_copyable< T >::value, "chunk data is used as raw bytes");
+		size_t size = 0;
+		void const *data = read_bytes(magic, sizeof(T), alignof(T), &size);
+		return ChunkSpan< T >(reinterpret_cast< T const * >(data), size / sizeof(T));
+	}
+
+	//the (unread) rest of the file:
+	ChunkSpan< char > remaining() const { return ChunkSpan< char >(mapped + offset, size - offset); }
+	bool at_end() const { return offset == size; }
+
+	std::string filename;
+
+	//--- internals ---
+	void const *read_bytes(std::string const &magic, size_t element_size, size_t element_align, size_t *size);
+
+	char const *mapped = nullptr; //file contents
+	size_t size = 0; //bytes in file
+	size_t offset = 0; //next byte to read
+
+	std::vector< std::unique_ptr< char[] > > realigned; //copies of any misaligned chunks
+
+	#if defined(_WIN32)
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#endif
+};
+
+//std::istream over a ChunkSpan< char > (for code that wants to keep reading a ChunkFile as a stream):
+struct ChunkStreamBuf : std::streambuf {
+	ChunkStreamBuf(ChunkSpan< char > const &span) {
+		char *begin = const_cast< char * >(span.begin()); //(streambuf wants non-const pointers, but never writes through get-area pointers)
+		setg(begin, begin, begin + span.size());
+	}
+};
@@ -0,0 +1,187 @@
+#include "resample.hpp"
+
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+
+//filter design parameters:
+constexpr uint32_t const BaseTaps = 64; //taps per phase when not reducing the rate (more when reducing, to keep the same transition width)
+constexpr double const Cutoff = 0.91; //filter cutoff, as a fraction of the lower of the two Nyquist frequencies
+constexpr double const KaiserBeta = 8.0; //about 80dB stopband attenuation
+constexpr uint32_t const MaxPhases = 1024; //rate ratios needing more phases than this use the nearest phase
+
+constexpr double const Pi = 3.14159265358979323846;
+
+//---------------- dot product kernels ----------------
+//(n is always a multiple of 8)
+
+static float dot_scalar(float const *a, float const *b, uint32_t n) {
+	float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	for (uint32_t i = 0; i < n; i += 4) {
+		sum[0] += a[i+0] * b[i+0];
+		sum[1] += a[i+1] * b[i+1];
+		sum[2] += a[i+2] * b[i+2];
+		sum[3] += a[i+3] * b[i+3];
+	}
+	return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2")
+static float dot_sse2(float const *a, float const *b, uint32_t n) {
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	for (uint32_t i = 0; i < n; i += 8) {
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	__m128 sum = _mm_add_ps(sum0, sum1);
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+}
+
+SIMD_TARGET("avx2")
+static float dot_avx2(float const *a, float const *b, uint32_t n) {
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+	uint32_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+		sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+	}
+	if (i < n) {
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+	}
+	__m256 sum8 = _mm256_add_ps(sum0, sum1);
+	__m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+}
+
+static float (* const dot)(float const *, float const *, uint32_t) =
+	simd_select(dot_scalar, dot_sse2, dot_avx2);
+
+#else
+
+static float (* const dot)(float const *, float const *, uint32_t) = dot_scalar;
+
+#endif //SIMD_X86
+
+//---------------- filter design ----------------
+
+//zeroth-order modified Bessel function of the first kind (for the Kaiser window):
+static double bessel_i0(double x) {
+	double sum = 1.0;
+	double term = 1.0;
+	for (uint32_t k = 1; k < 50; ++k) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12) break;
+	}
+	return sum;
+}
+
+Resampler::Resampler(uint32_t in_rate, uint32_t out_rate) {
+	assert(in_rate != 0 && out_rate != 0);
+	uint32_t g = std::gcd(in_rate, out_rate);
+	up = out_rate / g;
+	down = in_rate / g;
+	if (up == 1 && down == 1) return; //nothing to do (push() just copies)
+
+	//when reducing the rate, the filter's cutoff has to drop to the output's Nyquist frequency:
+	double ratio = std::min(1.0, double(up) / double(down));
+	double fc = Cutoff * ratio;
+	taps = uint32_t(std::ceil(BaseTaps / ratio));
+	taps = (taps + 7) / 8 * 8;
+	phases = std::min(up, MaxPhases);
+
+	//tap k of phase q is the filter evaluated at (q / phases + taps/2 - 1 - k) input samples from the output time:
+	double const half = 0.5 * double(taps);
+	double const i0_beta = bessel_i0(KaiserBeta);
+	coefficients.resize(size_t(phases) * taps);
+	for (uint32_t q = 0; q < phases; ++q) {
+		float *c = &coefficients[size_t(q) * taps];
+		double sum = 0.0;
+		for (uint32_t k = 0; k < taps; ++k) {
+			double t = double(q) / double(phases) + (half - 1.0) - double(k);
+			double x = fc * t;
+			double sinc = (x == 0.0 ? 1.0 : std::sin(Pi * x) / (Pi * x));
+			double w = t / half;
+			double window = (std::abs(w) >= 1.0 ? 0.0 : bessel_i0(KaiserBeta * std::sqrt(1.0 - w * w)) / i0_beta);
+			c[k] = float(fc * sinc * window);
+			sum += c[k];
+		}
+		//normalize each phase to unit gain at DC, so a constant signal stays constant:
+		for (uint32_t k = 0; k < taps; ++k) {
+			c[k] = float(c[k] / sum);
+		}
+	}
+
+	//everything before the first input sample is silence:
+	history.assign(taps / 2 - 1, 0.0f);
+	history_start = -int64_t(taps / 2 - 1);
+}
+
+//---------------- resampling ----------------
+
+uint64_t Resampler::output_length(uint64_t input) const {
+	return (input * up + down - 1) / down;
+}
+
+void Resampler::push(float const *in, size_t count, std::vector< float > *out) {
+	assert(out);
+	input_count += count;
+	if (taps == 0) {
+		out->insert(out->end(), in, in + count);
+		output_count += count;
+		return;
+	}
+	history.insert(history.end(), in, in + count);
+	produce(output_length(input_count), out);
+}
+
+void Resampler::finish(std::vector< float > *out) {
+	assert(out);
+	if (taps == 0) return;
+	//enough trailing silence for the last output's window (plus one, in case nearest-phase rounding moves it up a sample):
+	history.insert(history.end(), taps / 2 + 1, 0.0f);
+	produce(output_length(input_count), out);
+	assert(output_count == output_length(input_count));
+}
+
+void Resampler::produce(uint64_t limit, std::vector< float > *out) {
+	int64_t const history_end = history_start + int64_t(history.size());
+	while (output_count < limit) {
+		//output sample n lands at input position n * down / up = i + p / up:
+		uint64_t position = output_count * down;
+		int64_t i = int64_t(position / up);
+		uint32_t q = uint32_t(position % up);
+		if (phases != up) {
+			q = uint32_t((uint64_t(q) * phases + up / 2) / up);
+			if (q == phases) {
+				q = 0;
+				i += 1;
+			}
+		}
+		int64_t first = i - int64_t(taps / 2 - 1);
+		if (first + int64_t(taps) > history_end) break; //need more input
+		assert(first >= history_start);
+
+		out->emplace_back(dot(&coefficients[size_t(q) * taps], &history[size_t(first - history_start)], taps));
+		++output_count;
+	}
+
+	//drop input that no later output will use:
+	int64_t next_first = int64_t(output_count * down / up) - int64_t(taps / 2 - 1);
+	if (next_first > history_start) {
+		size_t drop = size_t(std::min(next_first, history_end) - history_start);
+		history.erase(history.begin(), history.begin() + drop);
+		history_start += int64_t(drop);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * Resampler converts mono audio between sampling rates with a polyphase windowed-sinc filter.
+ *
+ * It works in a streaming fashion -- feed input in chunks of any size with push(),
+ * then call finish() once to flush the filter's tail:
+ *
+ * Resampler resampler(44100, 48000);
+ * std::vector< float > out;
+ * out.reserve(resampler.output_length(total_frames)); //(optional)
+ * while (...) resampler.push(chunk, chunk_size, &out);
+ * resampler.finish(&out);
+ *
+ * Output sample n is the band-limited input signal evaluated at input time n * in_rate / out_rate,
+ * so the output has no delay relative to the input, and finish() brings the output to exactly
+ * output_length(total input) samples.
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Resampler {
+	Resampler(uint32_t in_rate, uint32_t out_rate);
+
+	//resample 'count' more input samples, appending any output they complete to 'out':
+	void push(float const *in, size_t count, std::vector< float > *out);
+
+	//resample the end of the input (treating everything after it as silence), appending the remaining output to 'out':
+	void finish(std::vector< float > *out);
+
+	//output samples produced for 'input' input samples:
+	uint64_t output_length(uint64_t input) const;
+
+	//--- internals ---
+	//rate ratio out_rate:in_rate, reduced:
+	uint32_t up = 1; //(L) output samples...
+	uint32_t down = 1; //(M) ...per this many input samples
+
+	uint32_t taps = 0; //filter taps per phase (a multiple of 8, for the SIMD kernels)
+	uint32_t phases = 0; //number of filter phases (== 'up' unless 'up' is very large)
+	std::vector< float > coefficients; //phases * taps, phase-major
+
+	std::vector< float > history; //input samples, starting at input index 'history_start' (which may be negative)
+	int64_t history_start = 0;
+	uint64_t input_count = 0; //input samples pushed so far
+	uint64_t output_count = 0; //output samples produced so far
+
+	//produce output while its input window lies within history, up to 'limit' samples total:
+	void produce(uint64_t limit, std::vector< float > *out);
+};
@@ -0,0 +1,102 @@
+//Benchmark for the Sound mixer's convolution reverb:
+// plays a fixed set of looping voices (all sending to the reverb) and times
+// mixing (via the null backend's Sound::render()) with no reverb and with impulse responses of various lengths,
+// to help pick impulse responses that fit the block budget.
+//
+// usage: reverb-bench [seconds ...]   (impulse response lengths; default: 0.25 0.5 1 2 4 8)
+
+#include "Sound.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+constexpr uint32_t BLOCK_FRAMES = Sound::MIX_SAMPLES;
+constexpr uint32_t AUDIO_RATE = Sound::AUDIO_RATE;
+
+int main(int argc, char **argv) {
+	std::vector< float > lengths;
+	for (int a = 1; a < argc; ++a) {
+		lengths.emplace_back(std::stof(argv[a]));
+	}
+	if (lengths.empty()) lengths = { 0.25f, 0.5f, 1.0f, 2.0f, 4.0f, 8.0f };
+
+	constexpr uint32_t Voices = 32;
+	constexpr uint32_t Blocks = 200;
+	double const budget_ms = 1000.0 * BLOCK_FRAMES / AUDIO_RATE;
+
+	std::mt19937 mt(0x15466);
+
+	//a few looping noise samples for the voices:
+	std::vector< Sound::Sample > samples;
+	for (uint32_t s = 0; s < 4; ++s) {
+		std::vector< float > data(AUDIO_RATE / 2 + 37 * s + 3);
+		for (auto &d : data) d = std::uniform_real_distribution< float >(-0.5f, 0.5f)(mt);
+		samples.emplace_back(data);
+	}
+
+	Sound::Settings settings;
+	settings.backend = Sound::Settings::Backend::Null;
+	Sound::init(settings);
+
+	std::vector< Sound::PlayingSample > playing;
+	for (uint32_t v = 0; v < Voices; ++v) {
+		playing.emplace_back(Sound::loop(samples[v % samples.size()], 0.5f, std::sin(float(v))));
+		playing.back().set_reverb_send(0.3f, 0.0f);
+	}
+
+	std::vector< float > buffer(2 * BLOCK_FRAMES);
+	//time the mixer, returning ms/block:
+	auto time_blocks = [&]() {
+		for (uint32_t b = 0; b < 8; ++b) { //warm up (also applies queued commands)
+			Sound::render(buffer.data(), BLOCK_FRAMES);
+		}
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t b = 0; b < Blocks; ++b) {
+			Sound::render(buffer.data(), BLOCK_FRAMES);
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration< double, std::milli >(after - before).count() / Blocks;
+	};
+
+	std::cout << "Mixing " << Voices << " voices in " << BLOCK_FRAMES << "-frame blocks; budget is " << budget_ms << " ms/block." << std::endl;
+	std::cout << std::setw(10) << "IR (s)" << std::setw(12) << "partitions"
+	          << std::setw(14) << "ms/block" << std::setw(14) << "reverb ms" << std::setw(12) << "% budget" << std::endl;
+
+	double dry_ms = time_blocks();
+	std::cout << std::setw(10) << "none" << std::setw(12) << 0
+	          << std::setw(14) << std::fixed << std::setprecision(3) << dry_ms
+	          << std::setw(14) << 0.0
+	          << std::setw(12) << std::setprecision(1) << (100.0 * dry_ms / budget_ms) << std::endl;
+
+	for (float length : lengths) {
+		//exponentially decaying noise, falling by 60dB over the impulse response:
+		std::vector< float > ir(std::max(1U, uint32_t(length * AUDIO_RATE)));
+		for (uint32_t i = 0; i < ir.size(); ++i) {
+			float decay = std::pow(10.0f, -3.0f * float(i) / float(ir.size()));
+			ir[i] = 0.1f * decay * std::uniform_real_distribution< float >(-1.0f, 1.0f)(mt);
+		}
+		Sound::set_reverb(Sound::Sample(ir));
+
+		double ms = time_blocks();
+		std::cout << std::setw(10) << std::setprecision(2) << length << std::setw(12) << ((ir.size() + BLOCK_FRAMES - 1) / BLOCK_FRAMES)
+		          << std::setw(14) << std::setprecision(3) << ms
+		          << std::setw(14) << std::setprecision(3) << (ms - dry_ms)
+		          << std::setw(12) << std::setprecision(1) << (100.0 * ms / budget_ms) << std::endl;
+	}
+
+	Sound::clear_reverb();
+	for (auto &p : playing) {
+		p.stop(0.0f);
+	}
+	Sound::render(buffer.data(), BLOCK_FRAMES);
+
+	Sound::shutdown();
+
+	return 0;
+}
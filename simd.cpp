@@ -0,0 +1,37 @@
+#include "simd.hpp"
+
+#include <SDL.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+SimdLevel simd_level() {
+	//(function-local static, so kernels can call this from their static initializers in any order)
+	static SimdLevel const level = []() {
+		SimdLevel supported = SimdLevel::Scalar;
+#ifdef SIMD_X86
+		if (SDL_HasAVX2()) supported = SimdLevel::AVX2;
+		else if (SDL_HasSSE2()) supported = SimdLevel::SSE2;
+#endif
+		char const *requested = std::getenv("SIMD_LEVEL");
+		if (!requested) return supported;
+		for (SimdLevel l : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 }) {
+			if (std::string(requested) != simd_level_name(l)) continue;
+			if (l > supported) {
+				std::cerr << "WARNING: SIMD_LEVEL=" << requested << " isn't supported by this CPU; using " << simd_level_name(supported) << "." << std::endl;
+				return supported;
+			}
+			return l;
+		}
+		std::cerr << "WARNING: ignoring unknown SIMD_LEVEL=" << requested << " (expecting scalar, sse2, or avx2)." << std::endl;
+		return supported;
+	}();
+	return level;
+}
+
+char const *simd_level_name(SimdLevel level) {
+	if (level == SimdLevel::AVX2) return "avx2";
+	if (level == SimdLevel::SSE2) return "sse2";
+	return "scalar";
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+//Shared setup for the SIMD kernels (mix_kernel.cpp, convolve.cpp, resample.cpp, spatialize.cpp, limiter.cpp, load_opus.cpp,
+// and Scene.cpp's frustum culling):
+// SSE2/AVX2 versions are only built for x86; other platforms use the scalar loops.
+// Each kernel picks its implementation at startup, based on simd_level() (below).
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86
+#include <immintrin.h>
+//gcc/clang need to be told that these functions may use instructions beyond the compile-time baseline:
+// (MSVC allows intrinsics anywhere)
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SIMD_TARGET(X)
+#else
+#define SIMD_TARGET(X) __attribute__((target(X)))
+#endif
+#endif
+
+//Instruction sets kernels can use, from least to most capable:
+enum class SimdLevel : uint8_t {
+	Scalar,
+	SSE2,
+	AVX2,
+};
+
+//The level kernels use: the best one the CPU supports, unless the SIMD_LEVEL environment variable
+// ("scalar", "sse2", or "avx2") asks for a lower one -- kernels round differently, so forcing a level
+// makes output comparable between machines (see mix-render). Read once, at startup.
+SimdLevel simd_level();
+char const *simd_level_name(SimdLevel level);
+
+//pick the implementation for simd_level():
+// (only call from code that runs after simd_level() can be -- e.g., static initializers, as the kernels do)
+template< typename Fn >
+Fn simd_select(Fn scalar, Fn sse2, Fn avx2) {
+	SimdLevel level = simd_level();
+	if (level == SimdLevel::AVX2) return avx2;
+	if (level == SimdLevel::SSE2) return sse2;
+	return scalar;
+}
@@ -0,0 +1,247 @@
+#include "spatialize.hpp"
+
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+//Panning angle is pi/4 + a, for a = (pi/4) * (direction from left to right, in [-1,1]); so
+// left = cos(pi/4 + a) = (cos(a) - sin(a)) / sqrt(2) and right = sin(pi/4 + a) = (cos(a) + sin(a)) / sqrt(2),
+// where |a| <= pi/4 -- small enough for a few terms of the Taylor series to be accurate to about 1e-7.
+constexpr float const QuarterPi = 0.785398163f;
+constexpr float const Sqrt2 = 1.414213562f;
+constexpr float const HalfSqrt2 = 0.707106781f;
+constexpr float const Sin3 = -1.0f / 6.0f, Sin5 = 1.0f / 120.0f, Sin7 = -1.0f / 5040.0f;
+constexpr float const Cos2 = -1.0f / 2.0f, Cos4 = 1.0f / 24.0f, Cos6 = -1.0f / 720.0f, Cos8 = 1.0f / 40320.0f;
+
+namespace {
+	//listener position and 'right' vector at one end of the block:
+	struct Ear {
+		float px, py, pz;
+		float rx, ry, rz;
+	};
+}
+
+//kernels process sources [begin, end):
+typedef void (*SpatializeFn)(Spatializer &s, Ear const &start, Ear const &end, float step, uint32_t begin, uint32_t end_);
+
+//---------------- scalar ----------------
+
+static inline void pan_scalar(float px, float py, float pz, Ear const &ear, float radius, float *l, float *r) {
+	float tx = px - ear.px;
+	float ty = py - ear.py;
+	float tz = pz - ear.pz;
+	float distance = std::sqrt(tx * tx + ty * ty + tz * tz);
+	if (distance == 0.0f) {
+		*l = *r = Sqrt2;
+		return;
+	}
+	float amt = (ear.rx * tx + ear.ry * ty + ear.rz * tz) / distance;
+	float a = QuarterPi * std::max(-1.0f, std::min(1.0f, amt));
+	float a2 = a * a;
+	float s = a * (1.0f + a2 * (Sin3 + a2 * (Sin5 + a2 * Sin7)));
+	float c = 1.0f + a2 * (Cos2 + a2 * (Cos4 + a2 * (Cos6 + a2 * Cos8)));
+	//linear (rather than squared) distance attenuation; att is 0.5 at distance == half_volume_radius:
+	// (HalfSqrt2 is folded in here, too)
+	float att = HalfSqrt2 / (1.0f + (distance / radius));
+	*l = (c - s) * att;
+	*r = (c + s) * att;
+}
+
+static void spatialize_scalar(Spatializer &s, Ear const &start, Ear const &end, float step, uint32_t begin, uint32_t end_) {
+	for (uint32_t i = begin; i < end_; ++i) {
+		pan_scalar(s.x[i], s.y[i], s.z[i], start, s.radius[i], &s.start_l[i], &s.start_r[i]);
+
+		//(ramps step as in Sound.cpp's step_value_ramp)
+		if (s.position_ramp[i] < step) {
+			s.end_x[i] = s.target_x[i];
+			s.end_y[i] = s.target_y[i];
+			s.end_z[i] = s.target_z[i];
+			s.position_ramp[i] = 0.0f;
+		} else {
+			float t = step / s.position_ramp[i];
+			s.end_x[i] = s.x[i] + t * (s.target_x[i] - s.x[i]);
+			s.end_y[i] = s.y[i] + t * (s.target_y[i] - s.y[i]);
+			s.end_z[i] = s.z[i] + t * (s.target_z[i] - s.z[i]);
+			s.position_ramp[i] -= step;
+		}
+		if (s.radius_ramp[i] < step) {
+			s.radius[i] = s.radius_target[i];
+			s.radius_ramp[i] = 0.0f;
+		} else {
+			s.radius[i] += (step / s.radius_ramp[i]) * (s.radius_target[i] - s.radius[i]);
+			s.radius_ramp[i] -= step;
+		}
+
+		pan_scalar(s.end_x[i], s.end_y[i], s.end_z[i], end, s.radius[i], &s.end_l[i], &s.end_r[i]);
+	}
+}
+
+#ifdef SIMD_X86
+
+//---------------- SSE2 ----------------
+//four sources per iteration:
+
+SIMD_TARGET("sse2")
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b) {
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+SIMD_TARGET("sse2")
+static inline void pan_sse2(__m128 px, __m128 py, __m128 pz, Ear const &ear, __m128 radius, float *l, float *r) {
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 tx = _mm_sub_ps(px, _mm_set1_ps(ear.px));
+	__m128 ty = _mm_sub_ps(py, _mm_set1_ps(ear.py));
+	__m128 tz = _mm_sub_ps(pz, _mm_set1_ps(ear.pz));
+	__m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz)));
+	__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(ear.rx), tx), _mm_mul_ps(_mm_set1_ps(ear.ry), ty)), _mm_mul_ps(_mm_set1_ps(ear.rz), tz));
+	//(lanes with distance == 0 get NaNs here, but are replaced below)
+	__m128 amt = _mm_max_ps(_mm_set1_ps(-1.0f), _mm_min_ps(one, _mm_div_ps(dot, distance)));
+	__m128 a = _mm_mul_ps(_mm_set1_ps(QuarterPi), amt);
+	__m128 a2 = _mm_mul_ps(a, a);
+	__m128 s = _mm_add_ps(_mm_set1_ps(Sin5), _mm_mul_ps(a2, _mm_set1_ps(Sin7)));
+	s = _mm_add_ps(_mm_set1_ps(Sin3), _mm_mul_ps(a2, s));
+	s = _mm_mul_ps(a, _mm_add_ps(one, _mm_mul_ps(a2, s)));
+	__m128 c = _mm_add_ps(_mm_set1_ps(Cos6), _mm_mul_ps(a2, _mm_set1_ps(Cos8)));
+	c = _mm_add_ps(_mm_set1_ps(Cos4), _mm_mul_ps(a2, c));
+	c = _mm_add_ps(_mm_set1_ps(Cos2), _mm_mul_ps(a2, c));
+	c = _mm_add_ps(one, _mm_mul_ps(a2, c));
+	__m128 att = _mm_div_ps(_mm_set1_ps(HalfSqrt2), _mm_add_ps(one, _mm_div_ps(distance, radius)));
+	__m128 here = _mm_cmpeq_ps(distance, _mm_setzero_ps());
+	_mm_storeu_ps(l, select4(here, _mm_set1_ps(Sqrt2), _mm_mul_ps(_mm_sub_ps(c, s), att)));
+	_mm_storeu_ps(r, select4(here, _mm_set1_ps(Sqrt2), _mm_mul_ps(_mm_add_ps(c, s), att)));
+}
+
+SIMD_TARGET("sse2")
+static void spatialize_sse2(Spatializer &s, Ear const &start, Ear const &end, float step, uint32_t begin, uint32_t end_) {
+	__m128 const step4 = _mm_set1_ps(step);
+	uint32_t i = begin;
+	for (; i + 4 <= end_; i += 4) {
+		__m128 x = _mm_loadu_ps(&s.x[i]);
+		__m128 y = _mm_loadu_ps(&s.y[i]);
+		__m128 z = _mm_loadu_ps(&s.z[i]);
+		__m128 radius = _mm_loadu_ps(&s.radius[i]);
+		pan_sse2(x, y, z, start, radius, &s.start_l[i], &s.start_r[i]);
+
+		//step ramps: (lanes with ramp < step snap to their targets, so the division there doesn't matter)
+		__m128 ramp = _mm_loadu_ps(&s.position_ramp[i]);
+		__m128 snap = _mm_cmplt_ps(ramp, step4);
+		__m128 t = _mm_div_ps(step4, ramp);
+		__m128 tx = _mm_loadu_ps(&s.target_x[i]);
+		__m128 ty = _mm_loadu_ps(&s.target_y[i]);
+		__m128 tz = _mm_loadu_ps(&s.target_z[i]);
+		x = select4(snap, tx, _mm_add_ps(x, _mm_mul_ps(t, _mm_sub_ps(tx, x))));
+		y = select4(snap, ty, _mm_add_ps(y, _mm_mul_ps(t, _mm_sub_ps(ty, y))));
+		z = select4(snap, tz, _mm_add_ps(z, _mm_mul_ps(t, _mm_sub_ps(tz, z))));
+		_mm_storeu_ps(&s.end_x[i], x);
+		_mm_storeu_ps(&s.end_y[i], y);
+		_mm_storeu_ps(&s.end_z[i], z);
+		_mm_storeu_ps(&s.position_ramp[i], select4(snap, _mm_setzero_ps(), _mm_sub_ps(ramp, step4)));
+
+		ramp = _mm_loadu_ps(&s.radius_ramp[i]);
+		snap = _mm_cmplt_ps(ramp, step4);
+		t = _mm_div_ps(step4, ramp);
+		__m128 target = _mm_loadu_ps(&s.radius_target[i]);
+		radius = select4(snap, target, _mm_add_ps(radius, _mm_mul_ps(t, _mm_sub_ps(target, radius))));
+		_mm_storeu_ps(&s.radius[i], radius);
+		_mm_storeu_ps(&s.radius_ramp[i], select4(snap, _mm_setzero_ps(), _mm_sub_ps(ramp, step4)));
+
+		pan_sse2(x, y, z, end, radius, &s.end_l[i], &s.end_r[i]);
+	}
+	spatialize_scalar(s, start, end, step, i, end_);
+}
+
+//---------------- AVX2 ----------------
+//eight sources per iteration:
+
+SIMD_TARGET("avx2")
+static inline void pan_avx2(__m256 px, __m256 py, __m256 pz, Ear const &ear, __m256 radius, float *l, float *r) {
+	__m256 const one = _mm256_set1_ps(1.0f);
+	__m256 tx = _mm256_sub_ps(px, _mm256_set1_ps(ear.px));
+	__m256 ty = _mm256_sub_ps(py, _mm256_set1_ps(ear.py));
+	__m256 tz = _mm256_sub_ps(pz, _mm256_set1_ps(ear.pz));
+	__m256 distance = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz)));
+	__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ear.rx), tx), _mm256_mul_ps(_mm256_set1_ps(ear.ry), ty)), _mm256_mul_ps(_mm256_set1_ps(ear.rz), tz));
+	//(lanes with distance == 0 get NaNs here, but are replaced below)
+	__m256 amt = _mm256_max_ps(_mm256_set1_ps(-1.0f), _mm256_min_ps(one, _mm256_div_ps(dot, distance)));
+	__m256 a = _mm256_mul_ps(_mm256_set1_ps(QuarterPi), amt);
+	__m256 a2 = _mm256_mul_ps(a, a);
+	__m256 s = _mm256_add_ps(_mm256_set1_ps(Sin5), _mm256_mul_ps(a2, _mm256_set1_ps(Sin7)));
+	s = _mm256_add_ps(_mm256_set1_ps(Sin3), _mm256_mul_ps(a2, s));
+	s = _mm256_mul_ps(a, _mm256_add_ps(one, _mm256_mul_ps(a2, s)));
+	__m256 c = _mm256_add_ps(_mm256_set1_ps(Cos6), _mm256_mul_ps(a2, _mm256_set1_ps(Cos8)));
+	c = _mm256_add_ps(_mm256_set1_ps(Cos4), _mm256_mul_ps(a2, c));
+	c = _mm256_add_ps(_mm256_set1_ps(Cos2), _mm256_mul_ps(a2, c));
+	c = _mm256_add_ps(one, _mm256_mul_ps(a2, c));
+	__m256 att = _mm256_div_ps(_mm256_set1_ps(HalfSqrt2), _mm256_add_ps(one, _mm256_div_ps(distance, radius)));
+	__m256 here = _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_EQ_OQ);
+	_mm256_storeu_ps(l, _mm256_blendv_ps(_mm256_mul_ps(_mm256_sub_ps(c, s), att), _mm256_set1_ps(Sqrt2), here));
+	_mm256_storeu_ps(r, _mm256_blendv_ps(_mm256_mul_ps(_mm256_add_ps(c, s), att), _mm256_set1_ps(Sqrt2), here));
+}
+
+SIMD_TARGET("avx2")
+static void spatialize_avx2(Spatializer &s, Ear const &start, Ear const &end, float step, uint32_t begin, uint32_t end_) {
+	__m256 const step8 = _mm256_set1_ps(step);
+	uint32_t i = begin;
+	for (; i + 8 <= end_; i += 8) {
+		__m256 x = _mm256_loadu_ps(&s.x[i]);
+		__m256 y = _mm256_loadu_ps(&s.y[i]);
+		__m256 z = _mm256_loadu_ps(&s.z[i]);
+		__m256 radius = _mm256_loadu_ps(&s.radius[i]);
+		pan_avx2(x, y, z, start, radius, &s.start_l[i], &s.start_r[i]);
+
+		//step ramps: (lanes with ramp < step snap to their targets, so the division there doesn't matter)
+		__m256 ramp = _mm256_loadu_ps(&s.position_ramp[i]);
+		__m256 snap = _mm256_cmp_ps(ramp, step8, _CMP_LT_OQ);
+		__m256 t = _mm256_div_ps(step8, ramp);
+		__m256 tx = _mm256_loadu_ps(&s.target_x[i]);
+		__m256 ty = _mm256_loadu_ps(&s.target_y[i]);
+		__m256 tz = _mm256_loadu_ps(&s.target_z[i]);
+		x = _mm256_blendv_ps(_mm256_add_ps(x, _mm256_mul_ps(t, _mm256_sub_ps(tx, x))), tx, snap);
+		y = _mm256_blendv_ps(_mm256_add_ps(y, _mm256_mul_ps(t, _mm256_sub_ps(ty, y))), ty, snap);
+		z = _mm256_blendv_ps(_mm256_add_ps(z, _mm256_mul_ps(t, _mm256_sub_ps(tz, z))), tz, snap);
+		_mm256_storeu_ps(&s.end_x[i], x);
+		_mm256_storeu_ps(&s.end_y[i], y);
+		_mm256_storeu_ps(&s.end_z[i], z);
+		_mm256_storeu_ps(&s.position_ramp[i], _mm256_blendv_ps(_mm256_sub_ps(ramp, step8), _mm256_setzero_ps(), snap));
+
+		ramp = _mm256_loadu_ps(&s.radius_ramp[i]);
+		snap = _mm256_cmp_ps(ramp, step8, _CMP_LT_OQ);
+		t = _mm256_div_ps(step8, ramp);
+		__m256 target = _mm256_loadu_ps(&s.radius_target[i]);
+		radius = _mm256_blendv_ps(_mm256_add_ps(radius, _mm256_mul_ps(t, _mm256_sub_ps(target, radius))), target, snap);
+		_mm256_storeu_ps(&s.radius[i], radius);
+		_mm256_storeu_ps(&s.radius_ramp[i], _mm256_blendv_ps(_mm256_sub_ps(ramp, step8), _mm256_setzero_ps(), snap));
+
+		pan_avx2(x, y, z, end, radius, &s.end_l[i], &s.end_r[i]);
+	}
+	spatialize_scalar(s, start, end, step, i, end_);
+}
+
+static SpatializeFn const spatialize =
+	simd_select(spatialize_scalar, spatialize_sse2, spatialize_avx2);
+
+#else
+
+static SpatializeFn const spatialize = spatialize_scalar;
+
+#endif //SIMD_X86
+
+//---------------- Spatializer ----------------
+
+Spatializer::Spatializer(uint32_t capacity) :
+	x(capacity), y(capacity), z(capacity),
+	target_x(capacity), target_y(capacity), target_z(capacity),
+	position_ramp(capacity),
+	radius(capacity), radius_target(capacity), radius_ramp(capacity),
+	end_x(capacity), end_y(capacity), end_z(capacity),
+	start_l(capacity), start_r(capacity),
+	end_l(capacity), end_r(capacity) {
+}
+
+void Spatializer::run(glm::vec3 const &start_position, glm::vec3 const &start_right,
+	glm::vec3 const &end_position, glm::vec3 const &end_right, float step) {
+	Ear start{start_position.x, start_position.y, start_position.z, start_right.x, start_right.y, start_right.z};
+	Ear end{end_position.x, end_position.y, end_position.z, end_right.x, end_right.y, end_right.z};
+	spatialize(*this, start, end, step, 0, count);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ * Spatializer computes 3D panning gains for a batch of sources at once.
+ *
+ * Sources are stored as structure-of-arrays (one array per field), so the work vectorizes across sources:
+ *
+ * Spatializer spatial(capacity);
+ * //every block: fill in sources [0, count)...
+ * spatial.count = 0;
+ * uint32_t k = spatial.count++;
+ * spatial.x[k] = position.x; ... spatial.radius_ramp[k] = half_volume_radius.ramp;
+ * //...step their ramps and compute the gains at both ends of the block:
+ * spatial.run(start_position, start_right, end_position, end_right, ramp_step);
+ * //...and read back start_l[k], end_l[k], end_x[k], ...
+ *
+ * Panning matches Sound's 3D panning: equal-power by direction (relative to the listener's 'right' vector),
+ * attenuated by 1 / (1 + distance / half_volume_radius). Sine and cosine use short polynomials
+ * (accurate to about 1e-7 over the needed range), rather than calling std::sin and std::cos.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct Spatializer {
+	Spatializer(uint32_t capacity);
+
+	uint32_t count = 0; //sources in the batch
+
+	//--- filled in by the caller, per source ---
+	//position ramp (as in Sound::Ramp: value, target, and remaining time):
+	std::vector< float > x, y, z;
+	std::vector< float > target_x, target_y, target_z;
+	std::vector< float > position_ramp; //(stepped in place)
+	//half volume radius ramp:
+	std::vector< float > radius; //(stepped in place)
+	std::vector< float > radius_target;
+	std::vector< float > radius_ramp; //(stepped in place)
+
+	//--- computed by run(), per source ---
+	std::vector< float > end_x, end_y, end_z; //position after one ramp step
+	std::vector< float > start_l, start_r; //gains at the start of the block
+	std::vector< float > end_l, end_r; //gains at the end of the block
+
+	//step every source's ramps by 'step' seconds, and compute gains before and after the step:
+	void run(glm::vec3 const &start_position, glm::vec3 const &start_right,
+		glm::vec3 const &end_position, glm::vec3 const &end_right, float step);
+};
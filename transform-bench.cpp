@@ -0,0 +1,123 @@
+//Benchmark comparing Scene's linked-list transforms with TransformArray's packed layout:
+// builds a random hierarchy of N transforms and times copying it and updating all world matrices.
+//
+// usage: transform-bench [transforms]   (default: 10000)
+
+#include "Scene.hpp"
+#include "TransformArray.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+
+//average milliseconds per call of fn, over enough repetitions to get a stable number:
+template< typename F >
+static double time_ms(F const &fn) {
+	//warm up:
+	fn();
+	uint32_t reps = 0;
+	auto before = std::chrono::high_resolution_clock::now();
+	auto after = before;
+	do {
+		fn();
+		++reps;
+		after = std::chrono::high_resolution_clock::now();
+	} while (after - before < std::chrono::milliseconds(250));
+	return std::chrono::duration< double, std::milli >(after - before).count() / reps;
+}
+
+int main(int argc, char **argv) {
+	uint32_t count = 10000;
+	if (argc > 1) count = uint32_t(std::stoul(argv[1]));
+
+	//random forest: most transforms have a parent among the earlier ones, which gives a mix of depths:
+	std::mt19937 mt(0x15466);
+	Scene scene;
+	std::vector< Scene::Transform * > list_transforms;
+	for (uint32_t i = 0; i < count; ++i) {
+		scene.transforms.emplace_back();
+		Scene::Transform &t = scene.transforms.back();
+		t.name = "t" + std::to_string(i);
+		t.position = glm::vec3(float(mt() % 100) * 0.1f, float(mt() % 100) * 0.1f, float(mt() % 100) * 0.1f);
+		t.rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		if (i > 0 && mt() % 8 != 0) {
+			//prefer recent transforms as parents, so some chains get deep:
+			uint32_t back = std::min< uint32_t >(i, 1 + mt() % 16);
+			t.parent = list_transforms[i - back];
+		}
+		list_transforms.emplace_back(&t);
+	}
+
+	TransformArray packed;
+	packed.set(scene);
+
+	uint32_t max_depth = 0;
+	for (uint32_t i = 0; i < packed.size(); ++i) {
+		uint32_t depth = 0;
+		for (uint32_t p = packed.parents[i]; p != -1U; p = packed.parents[p]) ++depth;
+		max_depth = std::max(max_depth, depth);
+	}
+	std::cout << count << " transforms, max depth " << max_depth << "." << std::endl;
+
+	//n.b. the results are summed into 'sink' so the work can't be optimized away:
+	float sink = 0.0f;
+
+	//--- copy ---
+	double list_copy = time_ms([&](){
+		Scene copy(scene);
+		sink += copy.transforms.back().position.x;
+	});
+	double packed_copy = time_ms([&](){
+		TransformArray copy(packed);
+		sink += copy.positions.back().x;
+	});
+
+	//--- update with everything moving ---
+	float t = 0.0f;
+	double list_update = time_ms([&](){
+		t += 0.01f;
+		for (auto &xf : scene.transforms) xf.position.z = t;
+		scene.update_transforms();
+		sink += scene.transforms.back().cache.local_to_world[3].x;
+	});
+	double packed_update = time_ms([&](){
+		t += 0.01f;
+		for (auto &p : packed.positions) p.z = t;
+		packed.update();
+		sink += packed.local_to_world.back()[3].x;
+	});
+
+	//--- update with nothing moving ---
+	double list_static = time_ms([&](){
+		scene.update_transforms();
+		sink += scene.transforms.back().cache.local_to_world[3].x;
+	});
+	double packed_static = time_ms([&](){
+		packed.update();
+		sink += packed.local_to_world.back()[3].x;
+	});
+
+	//--- uncached recursive update (what make_local_to_world() used to cost for every transform) ---
+	double list_recursive = time_ms([&](){
+		for (auto const &xf : scene.transforms) {
+			glm::mat4x3 m = xf.make_local_to_parent();
+			for (Scene::Transform const *p = xf.parent; p; p = p->parent) {
+				m = p->make_local_to_parent() * glm::mat4(m);
+			}
+			sink += m[3].x;
+		}
+	});
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << std::setw(28) << "" << std::setw(12) << "list (ms)" << std::setw(12) << "packed (ms)" << std::endl;
+	std::cout << std::setw(28) << "copy" << std::setw(12) << list_copy << std::setw(12) << packed_copy << std::endl;
+	std::cout << std::setw(28) << "update (all moving)" << std::setw(12) << list_update << std::setw(12) << packed_update << std::endl;
+	std::cout << std::setw(28) << "update (none moving)" << std::setw(12) << list_static << std::setw(12) << packed_static << std::endl;
+	std::cout << std::setw(28) << "uncached recursive" << std::setw(12) << list_recursive << std::setw(12) << "-" << std::endl;
+	std::cout << "(checksum " << sink << ")" << std::endl;
+
+	return 0;
+}